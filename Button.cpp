@@ -7,53 +7,91 @@ static void callback_wrapper(void* obj) {
 }
 
 // Wired Button
-WiredButton::WiredButton(const int id, const int button_pin, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback), _button(OneButton(button_pin, true))
+WiredButton::WiredButton(const int id, const int button_pin, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback), _button(OneButton(button_pin, true)), _pin(button_pin)
 {
   _button.setClickMs(0);
   _button.setPressMs(0);
   _button.setIdleMs(0);
   _button.setDebounceMs(10);
   _button.attachLongPressStart([](void *ctx){callback_wrapper(ctx);}, this);
+  // (the OneButton has already set the pin up as an input with pull-up)
+  _held = (digitalRead(_pin) == LOW);
 }
 
 void WiredButton::hw_loop() {
+  if (_held) {
+    _held = (digitalRead(_pin) == LOW);
+    return;
+  }
   _button.tick();
 }
 
 // Wireless Button
-WirelessButton::WirelessButton(const int id, const unsigned int button_intr, const unsigned long button_code, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback)
+WirelessButton::WirelessButton(const int id, RFReceiver *receiver, const unsigned long button_code, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback), _receiver(receiver)
 {
-  _last_click_time = 0;
+  _last_code_us = 0 - WIRELESS_LOCKOUT_US;
   _button_code = button_code;
-  _switch.enableReceive(button_intr);
 }
 
 void WirelessButton::hw_loop() {
-  unsigned long reading = _switch.getReceivedValue();
-  unsigned long sample_time = millis();
-
-  if (reading > 0) {
-    if (reading == _button_code) {
-      // if the button was pressed
-      //Log.traceln(F("%d %d %d %d"), reading, sample_time, _last_click_time, sample_time - _last_click_time);
-      if ((sample_time - _last_click_time) > 150) {
-        on_click();
-      }
-
-      _last_click_time = sample_time;
+  // the receiver has already decoded this loop's codes, there can be more
+  // than one of ours if the loop was held up
+  for (uint8_t i = 0; i < _receiver->code_count(); i++) {
+    if (_receiver->code(i) != _button_code) {
+      continue;
+    }
+
+    // remotes repeat a code for as long as they are held, so only the first
+    // of a run is a click (timed on air, so a late decode doesn't merge two)
+    unsigned long code_us = _receiver->code_time_us(i);
+    if ((code_us - _last_code_us) > WIRELESS_LOCKOUT_US) {
+      on_click();
     }
+    _last_code_us = code_us;
+  }
+}
+
+// Bus Button
+BusButton::BusButton(const int id, ButtonBus *bus, const unsigned int input, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback), _button(OneButton()), _bus(bus), _input(input)
+{
+  _button.setClickMs(0);
+  _button.setPressMs(0);
+  _button.setIdleMs(0);
+  _button.setDebounceMs(10);
+  _button.attachLongPressStart([](void *ctx){callback_wrapper(ctx);}, this);
+  _held = _bus->read(_input);
+}
+
+void BusButton::hw_loop() {
+  // the bus has already been scanned this loop, so this is just a bit lookup
+  if (_held) {
+    _held = _bus->read(_input);
+    return;
   }
+  _button.tick(_bus->read(_input));
 }
 
-void WirelessButton::hw_reset() {
-  _switch.resetAvailable();
+// Matrix Button
+MatrixButton::MatrixButton(const int id, ButtonMatrix *matrix, const unsigned int row, const unsigned int col, const int led_pin, void* context, callback_function callback) : Button(id, led_pin, context, callback), _matrix(matrix), _row(row), _col(col)
+{
+  // a key already down (e.g. held through a reload) isn't a new press
+  _pressed = _matrix->read(_row, _col);
+}
+
+void MatrixButton::hw_loop() {
+  // the matrix does the debounce, so just fire on the press edge
+  bool pressed = _matrix->read(_row, _col);
+  if (pressed && !_pressed) {
+    on_click();
+  }
+  _pressed = pressed;
 }
 
 // Button class
-Button::Button(const int id, const int led_pin, void* context, callback_function callback) : _id(id), _led(ezLED(led_pin)), _context(context), _callback(callback)
+Button::Button(const int id, const int led_pin, void* context, callback_function callback) : _id(id), _led(LEDs.add(led_pin)), _context(context), _callback(callback)
 {
   // initialise the LED state to on
-  _led.turnON();
+  LEDs.set(_led, true);
 }
 
 int Button::id() {
@@ -61,11 +99,11 @@ int Button::id() {
 }
 
 void Button::led_on(unsigned long delay) {
-  _led.turnON(delay);
+  LEDs.set(_led, true, delay);
 }
 
 void Button::led_off(unsigned long delay) {
-  _led.turnOFF(delay);
+  LEDs.set(_led, false, delay);
 }
 
 callback_function Button::callback() {
@@ -80,10 +118,8 @@ void Button::on_click() {
 }
 
 void Button::loop() {
-  // call the button loop
+  // call the button loop (the LED is driven by the LED engine)
   hw_loop();
-  // call the LED loop
-  _led.loop();
 }
 
 void Button::reset() {
@@ -2,10 +2,14 @@
 #define _Button_H
 
 #include <OneButton.h>
-#include <RCSwitch.h>
-#include <ezLED.h>
+#include "ButtonBus.h"
+#include "ButtonMatrix.h"
+#include "RFReceiver.h"
+#include "LEDEngine.h"
 
 #define LED_HOLDTIME 125
+// a remote has to be quiet for this long before its code is a new click
+#define WIRELESS_LOCKOUT_US 150000UL
 
 extern "C" {
 typedef void (*callback_function)(void *);
@@ -14,7 +18,9 @@ typedef void (*callback_function)(void *);
 // button types
 typedef enum button_type {
   BUTTON_WIRED,
-  BUTTON_WIRELESS
+  BUTTON_WIRELESS,
+  BUTTON_BUS,
+  BUTTON_MATRIX
 } ButtonType;
 
 // Button
@@ -22,12 +28,13 @@ class Button
 {
 private:
   const int _id;
-  ezLED _led;
+  const int _led;
   void* _context;
   callback_function _callback;
 
 public:
   Button(const int id, const int led_pin, void* context, callback_function callback);
+  virtual ~Button() {}
 
   // accessors
   int id();
@@ -54,23 +61,56 @@ class WiredButton : public Button
 {
 private:
   OneButton _button;
+  const int _pin;
+  // down since the button was created (e.g. held through a reload), so not a
+  // press until it has been released
+  bool _held;
+
 public:
   WiredButton(const int id, const int button_pin, const int led_pin, void* context, callback_function callback);
   void hw_loop();
 };
 
-// WirelessButton type
+// WirelessButton type (a code from a 433MHz remote)
 class WirelessButton : public Button
 {
 private:
-  RCSwitch _switch;
-  unsigned long _last_click_time;
+  RFReceiver *_receiver;
+  unsigned long _last_code_us;
   unsigned long _button_code;
 
 public:
-  WirelessButton(const int id, const unsigned int button_intr, const unsigned long button_code, const int led_pin, void* context, callback_function callback);
+  WirelessButton(const int id, RFReceiver *receiver, const unsigned long button_code, const int led_pin, void* context, callback_function callback);
+  void hw_loop();
+};
+
+// BusButton type (an input on a shift register/expander bus)
+class BusButton : public Button
+{
+private:
+  OneButton _button;
+  ButtonBus *_bus;
+  const unsigned int _input;
+  // as for WiredButton
+  bool _held;
+
+public:
+  BusButton(const int id, ButtonBus *bus, const unsigned int input, const int led_pin, void* context, callback_function callback);
+  void hw_loop();
+};
+
+// MatrixButton type (a key in a row/column matrix)
+class MatrixButton : public Button
+{
+private:
+  ButtonMatrix *_matrix;
+  const unsigned int _row;
+  const unsigned int _col;
+  bool _pressed;
+
+public:
+  MatrixButton(const int id, ButtonMatrix *matrix, const unsigned int row, const unsigned int col, const int led_pin, void* context, callback_function callback);
   void hw_loop();
-  void hw_reset();
 };
 
 #endif
@@ -0,0 +1,261 @@
+#include <ArduinoLog.h>
+#include "ButtonBus.h"
+
+// MCP23x17 registers (IOCON.BANK = 0)
+#define MCP_IODIRA   0x00
+#define MCP_GPINTENA 0x04
+#define MCP_INTCONA  0x08
+#define MCP_IOCON    0x0A
+#define MCP_GPPUA    0x0C
+#define MCP_GPIOA    0x12
+
+// MCP23x17 IOCON bits
+#define MCP_IOCON_MIRROR 0x40
+#define MCP_IOCON_HAEN   0x08
+#define MCP_IOCON_ODR    0x04
+
+// MCP23x17 base addresses/opcodes
+#define MCP_I2C_BASE 0x20
+#define MCP_SPI_WRITE 0x40
+#define MCP_SPI_READ  0x41
+
+// interrupt handlers - attachInterrupt() has no context argument, so each
+// interrupt capable bus gets a slot with its own trampoline
+static ButtonBus *intr_buses[BUS_MAX_INTR];
+
+static void intr_bus_0() { intr_buses[0]->on_interrupt(); }
+static void intr_bus_1() { intr_buses[1]->on_interrupt(); }
+static void intr_bus_2() { intr_buses[2]->on_interrupt(); }
+static void intr_bus_3() { intr_buses[3]->on_interrupt(); }
+
+static void (*intr_handlers[BUS_MAX_INTR])() = { intr_bus_0, intr_bus_1, intr_bus_2, intr_bus_3 };
+
+// Button Bus
+ButtonBus::ButtonBus(const int id, const unsigned int chip_count, const unsigned long scan_ms, const int intr_pin) : _id(id), _chip_count(chip_count), _scan_ms(scan_ms), _intr_pin(intr_pin)
+{
+  _byte_count = 0;
+  _last_scan = 0;
+  _active = false;
+  _pending = true;
+  // inputs are pulled up, so idle is all ones
+  memset(_state, 0xFF, sizeof(_state));
+}
+
+int ButtonBus::id() {
+  return _id;
+}
+
+unsigned int ButtonBus::input_count() {
+  return _byte_count * 8;
+}
+
+bool ButtonBus::read(const unsigned int input) {
+  if (input >= input_count()) {
+    return false;
+  }
+  return (_state[input >> 3] & (1 << (input & 7))) == 0;
+}
+
+void ButtonBus::begin() {
+  // work out how many bytes a full read of the chain is
+  _byte_count = (_chip_count * hw_width()) / 8;
+  if (_byte_count > BUS_MAX_BYTES) {
+    Log.errorln(F("BUS: bus %d has too many inputs (%d), limiting to %d"), _id, _byte_count * 8, BUS_MAX_BYTES * 8);
+    _byte_count = BUS_MAX_BYTES;
+  }
+
+  // initialise the hardware
+  hw_begin();
+
+  // attach the interrupt line if there is one
+  if (_intr_pin != BUS_NO_INTR) {
+    int slot;
+    for (slot = 0; slot < BUS_MAX_INTR && intr_buses[slot] != nullptr; slot++);
+    if (slot == BUS_MAX_INTR) {
+      Log.errorln(F("BUS: no free interrupt slots for bus %d, polling instead"), _id);
+      _intr_pin = BUS_NO_INTR;
+    } else {
+      intr_buses[slot] = this;
+      // the pull-up holds the (open-drain) line high between interrupts
+      pinMode(_intr_pin, INPUT_PULLUP);
+      attachInterrupt(digitalPinToInterrupt(_intr_pin), intr_handlers[slot], FALLING);
+    }
+  }
+
+  // initial read (also clears any interrupt latched before we attached)
+  _pending = true;
+  scan();
+}
+
+void ButtonBus::scan() {
+  unsigned long now = millis();
+
+  if (_intr_pin != BUS_NO_INTR) {
+    // interrupt driven, only read when the chips signal a change or while an
+    // input is held (so releases are followed through the debounce)
+    if (!_pending && !(_active && (now - _last_scan) >= _scan_ms)) {
+      return;
+    }
+  } else if ((now - _last_scan) < _scan_ms) {
+    return;
+  }
+
+  // clear before reading so a change during the read triggers another one
+  _pending = false;
+  _last_scan = now;
+  hw_read();
+
+  // the INT line is shared, so if a chip read early in the burst changed again
+  // it (or one read later) can still be holding it low, with no new edge coming
+  if (_intr_pin != BUS_NO_INTR && digitalRead(_intr_pin) == LOW) {
+    _pending = true;
+  }
+
+  // note whether anything is held
+  _active = false;
+  for (unsigned int i = 0; i < _byte_count; i++) {
+    if (_state[i] != 0xFF) {
+      _active = true;
+      break;
+    }
+  }
+}
+
+void ButtonBus::on_interrupt() {
+  _pending = true;
+}
+
+// Shift Register Bus (74HC165)
+ShiftRegisterBus::ShiftRegisterBus(const int id, const int latch_pin, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin) : ButtonBus(id, chip_count, scan_ms, intr_pin), _latch_pin(latch_pin), _settings(SPISettings(clock, MSBFIRST, SPI_MODE0))
+{
+}
+
+unsigned int ShiftRegisterBus::hw_width() {
+  return 8;
+}
+
+void ShiftRegisterBus::hw_begin() {
+  pinMode(_latch_pin, OUTPUT);
+  digitalWrite(_latch_pin, HIGH);
+  SPI.begin();
+}
+
+void ShiftRegisterBus::hw_read() {
+  // latch the parallel inputs
+  digitalWrite(_latch_pin, LOW);
+  digitalWrite(_latch_pin, HIGH);
+
+  // shift the whole chain out in one transaction (input H of the chip nearest
+  // MISO arrives first, so byte n is chip n and bit 0 is input A)
+  SPI.beginTransaction(_settings);
+  for (unsigned int i = 0; i < _byte_count; i++) {
+    _state[i] = SPI.transfer(0);
+  }
+  SPI.endTransaction();
+}
+
+// MCP23017 Bus (I2C)
+MCP23017Bus::MCP23017Bus(const int id, const uint8_t address, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin) : ButtonBus(id, chip_count, scan_ms, intr_pin), _address(MCP_I2C_BASE + address), _clock(clock)
+{
+}
+
+unsigned int MCP23017Bus::hw_width() {
+  return 16;
+}
+
+void MCP23017Bus::write_register(const uint8_t address, const uint8_t reg, const uint8_t value) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+void MCP23017Bus::hw_begin() {
+  Wire.begin();
+  Wire.setClock(_clock);
+
+  // every chip's INT is wired to the one interrupt pin, so they are open-drain
+  // (pulled up by the board's pin) rather than driving against each other
+  uint8_t intr = (_intr_pin != BUS_NO_INTR) ? 0xFF : 0x00;
+  uint8_t iocon = MCP_IOCON_MIRROR | ((_intr_pin != BUS_NO_INTR) ? MCP_IOCON_ODR : 0);
+  for (unsigned int chip = 0; chip < _byte_count / 2; chip++) {
+    uint8_t address = _address + chip;
+    // mirror INTA/INTB so either line can be wired, all pins inputs with pull-ups
+    write_register(address, MCP_IOCON, iocon);
+    for (uint8_t port = 0; port < 2; port++) {
+      write_register(address, MCP_IODIRA + port, 0xFF);
+      write_register(address, MCP_GPPUA + port, 0xFF);
+      write_register(address, MCP_INTCONA + port, 0x00);
+      write_register(address, MCP_GPINTENA + port, intr);
+    }
+  }
+}
+
+void MCP23017Bus::hw_read() {
+  // read GPIOA/GPIOB together (also clears the interrupt)
+  for (unsigned int chip = 0; chip < _byte_count / 2; chip++) {
+    uint8_t address = _address + chip;
+    Wire.beginTransmission(address);
+    Wire.write(MCP_GPIOA);
+    Wire.endTransmission(false);
+    if (Wire.requestFrom(address, (uint8_t)2) == 2) {
+      _state[chip * 2] = Wire.read();
+      _state[chip * 2 + 1] = Wire.read();
+    }
+  }
+}
+
+// MCP23S17 Bus (SPI)
+MCP23S17Bus::MCP23S17Bus(const int id, const int cs_pin, const uint8_t address, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin) : ButtonBus(id, chip_count, scan_ms, intr_pin), _cs_pin(cs_pin), _address(address), _settings(SPISettings(clock, MSBFIRST, SPI_MODE0))
+{
+}
+
+unsigned int MCP23S17Bus::hw_width() {
+  return 16;
+}
+
+void MCP23S17Bus::write_register(const uint8_t address, const uint8_t reg, const uint8_t value) {
+  SPI.beginTransaction(_settings);
+  digitalWrite(_cs_pin, LOW);
+  SPI.transfer(MCP_SPI_WRITE | (address << 1));
+  SPI.transfer(reg);
+  SPI.transfer(value);
+  digitalWrite(_cs_pin, HIGH);
+  SPI.endTransaction();
+}
+
+void MCP23S17Bus::hw_begin() {
+  pinMode(_cs_pin, OUTPUT);
+  digitalWrite(_cs_pin, HIGH);
+  SPI.begin();
+
+  // open-drain INT, as for the MCP23017
+  uint8_t intr = (_intr_pin != BUS_NO_INTR) ? 0xFF : 0x00;
+  uint8_t iocon = MCP_IOCON_MIRROR | MCP_IOCON_HAEN | ((_intr_pin != BUS_NO_INTR) ? MCP_IOCON_ODR : 0);
+  for (unsigned int chip = 0; chip < _byte_count / 2; chip++) {
+    uint8_t address = _address + chip;
+    // chips ignore the address bits until HAEN is set, so the first IOCON
+    // write reaches (and enables hardware addressing on) every chip on the CS line
+    write_register(address, MCP_IOCON, iocon);
+    for (uint8_t port = 0; port < 2; port++) {
+      write_register(address, MCP_IODIRA + port, 0xFF);
+      write_register(address, MCP_GPPUA + port, 0xFF);
+      write_register(address, MCP_INTCONA + port, 0x00);
+      write_register(address, MCP_GPINTENA + port, intr);
+    }
+  }
+}
+
+void MCP23S17Bus::hw_read() {
+  // read GPIOA/GPIOB of every chip in one transaction
+  SPI.beginTransaction(_settings);
+  for (unsigned int chip = 0; chip < _byte_count / 2; chip++) {
+    digitalWrite(_cs_pin, LOW);
+    SPI.transfer(MCP_SPI_READ | ((_address + chip) << 1));
+    SPI.transfer(MCP_GPIOA);
+    _state[chip * 2] = SPI.transfer(0);
+    _state[chip * 2 + 1] = SPI.transfer(0);
+    digitalWrite(_cs_pin, HIGH);
+  }
+  SPI.endTransaction();
+}
@@ -0,0 +1,109 @@
+#ifndef _ButtonBus_H
+#define _ButtonBus_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+
+// maximum inputs per bus (16 bytes = 128 inputs)
+#define BUS_MAX_BYTES 16
+// maximum number of buses that can use an interrupt line
+#define BUS_MAX_INTR 4
+// no interrupt line configured
+#define BUS_NO_INTR -1
+
+// bus types
+typedef enum bus_type {
+  BUS_SHIFTREG,
+  BUS_MCP23017,
+  BUS_MCP23S17
+} BusType;
+
+// ButtonBus - a chain of input chips that is read in a single burst per scan,
+// with the result cached so that each button only does a bit lookup
+class ButtonBus
+{
+protected:
+  const int _id;
+  const unsigned int _chip_count;
+  const unsigned long _scan_ms;
+  int _intr_pin;
+  unsigned int _byte_count;
+  uint8_t _state[BUS_MAX_BYTES];
+  unsigned long _last_scan;
+  bool _active;
+  volatile bool _pending;
+
+public:
+  ButtonBus(const int id, const unsigned int chip_count, const unsigned long scan_ms, const int intr_pin);
+  virtual ~ButtonBus() {}
+
+  // accessors
+  int id();
+  unsigned int input_count();
+
+  // input state (true if the input is pressed, inputs are active low)
+  bool read(const unsigned int input);
+
+  // eventloop functions
+  void begin();
+  void scan();
+  void on_interrupt();
+
+  // functions implemented by the various bus type subclasses
+  virtual unsigned int hw_width() = 0;
+  virtual void hw_begin() {}
+  virtual void hw_read() = 0;
+};
+
+// ShiftRegisterBus - a chain of 74HC165 parallel-in/serial-out registers on SPI
+class ShiftRegisterBus : public ButtonBus
+{
+private:
+  const int _latch_pin;
+  SPISettings _settings;
+
+public:
+  ShiftRegisterBus(const int id, const int latch_pin, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin);
+  unsigned int hw_width();
+  void hw_begin();
+  void hw_read();
+};
+
+// MCP23017Bus - MCP23017 16-bit expanders on I2C, at consecutive addresses.
+// With an interrupt pin the INT outputs of every chip are wired together to
+// it, so they are set open-drain (needing only the pin's own pull-up).
+class MCP23017Bus : public ButtonBus
+{
+private:
+  const uint8_t _address;
+  const unsigned long _clock;
+
+  void write_register(const uint8_t address, const uint8_t reg, const uint8_t value);
+
+public:
+  MCP23017Bus(const int id, const uint8_t address, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin);
+  unsigned int hw_width();
+  void hw_begin();
+  void hw_read();
+};
+
+// MCP23S17Bus - MCP23S17 16-bit expanders on SPI, sharing a chip select and
+// using hardware addressing
+class MCP23S17Bus : public ButtonBus
+{
+private:
+  const int _cs_pin;
+  const uint8_t _address;
+  SPISettings _settings;
+
+  void write_register(const uint8_t address, const uint8_t reg, const uint8_t value);
+
+public:
+  MCP23S17Bus(const int id, const int cs_pin, const uint8_t address, const unsigned int chip_count, const unsigned long clock, const unsigned long scan_ms, const int intr_pin);
+  unsigned int hw_width();
+  void hw_begin();
+  void hw_read();
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <ArduinoLog.h>
+#include "ButtonMatrix.h"
+
+// Button Matrix
+ButtonMatrix::ButtonMatrix(const int id, const uint8_t *row_pins, const uint8_t row_count, const uint8_t *col_pins, const uint8_t col_count, const unsigned long scan_us, const unsigned long debounce_ms, const bool diodes) :
+  _id(id),
+  _row_count(min(row_count, (uint8_t)MATRIX_MAX_ROWS)),
+  _col_count(min(col_count, (uint8_t)MATRIX_MAX_COLS)),
+  _scan_us(max(scan_us, 1UL)),
+  _debounce_scans(constrain((debounce_ms * 1000) / max(scan_us, 1UL), 1UL, 255UL)),
+  _diodes(diodes)
+{
+  memcpy(_row_pins, row_pins, _row_count);
+  memcpy(_col_pins, col_pins, _col_count);
+  memset(_raw, 0, sizeof(_raw));
+  memset(_state, 0, sizeof(_state));
+  memset(_blocked, 0, sizeof(_blocked));
+  memset(_counter, 0, sizeof(_counter));
+  _next_scan = 0;
+  _scan_time_max = 0;
+  _scan_late_max = 0;
+  _ghost_count = 0;
+}
+
+int ButtonMatrix::id() {
+  return _id;
+}
+
+bool ButtonMatrix::read(const unsigned int row, const unsigned int col) {
+  if (row >= _row_count || col >= _col_count) {
+    return false;
+  }
+  return (_state[row] >> col) & 1;
+}
+
+unsigned long ButtonMatrix::worst_case_latency_us() {
+  // the first scan after a press is at most one period (plus lateness) away
+  // and the key then needs _debounce_scans agreeing scans on the fixed schedule
+  return (unsigned long)_debounce_scans * _scan_us + _scan_late_max + _scan_time_max;
+}
+
+unsigned long ButtonMatrix::scan_time_max_us() {
+  return _scan_time_max;
+}
+
+unsigned long ButtonMatrix::scan_late_max_us() {
+  return _scan_late_max;
+}
+
+unsigned long ButtonMatrix::ghost_count() {
+  return _ghost_count;
+}
+
+void ButtonMatrix::begin() {
+  // rows are only driven (low) while being scanned, otherwise left floating so
+  // that two pressed keys in one column never short two driven rows
+  for (uint8_t row = 0; row < _row_count; row++) {
+    pinMode(_row_pins[row], INPUT);
+  }
+  for (uint8_t col = 0; col < _col_count; col++) {
+    pinMode(_col_pins[col], INPUT_PULLUP);
+  }
+
+  // do one scan so the timing is known, then report the bound
+  _next_scan = micros();
+  scan();
+  Log.traceln(F("MATRIX: matrix %d is %dx%d, scan %uus, debounce %d scans, worst case latency %uus"),
+              _id, _row_count, _col_count, _scan_us, _debounce_scans, worst_case_latency_us());
+  if (_scan_time_max > _scan_us) {
+    Log.errorln(F("MATRIX: matrix %d took %uus to scan, longer than its scan period"), _id, _scan_time_max);
+  }
+}
+
+void ButtonMatrix::read_raw() {
+  for (uint8_t row = 0; row < _row_count; row++) {
+    pinMode(_row_pins[row], OUTPUT);
+    digitalWrite(_row_pins[row], LOW);
+    delayMicroseconds(MATRIX_SETTLE_US);
+
+    uint16_t cols = 0;
+    for (uint8_t col = 0; col < _col_count; col++) {
+      if (digitalRead(_col_pins[col]) == LOW) {
+        cols |= ((uint16_t)1 << col);
+      }
+    }
+    _raw[row] = cols;
+
+    pinMode(_row_pins[row], INPUT);
+  }
+}
+
+void ButtonMatrix::block_ghosts() {
+  // without diodes, three closed corners of a rectangle make the fourth read
+  // as closed too - any two rows sharing two or more closed columns are
+  // ambiguous, so those keys are held in their current state until it clears
+  bool was_blocked = false;
+  bool is_blocked = false;
+
+  for (uint8_t row = 0; row < _row_count; row++) {
+    was_blocked |= (_blocked[row] != 0);
+    _blocked[row] = 0;
+  }
+
+  for (uint8_t r1 = 0; r1 < _row_count; r1++) {
+    if ((_raw[r1] & (_raw[r1] - 1)) == 0) {
+      // fewer than two closed columns, can't be part of a rectangle
+      continue;
+    }
+    for (uint8_t r2 = r1 + 1; r2 < _row_count; r2++) {
+      uint16_t common = _raw[r1] & _raw[r2];
+      if (common & (common - 1)) {
+        _blocked[r1] |= common;
+        _blocked[r2] |= common;
+        is_blocked = true;
+      }
+    }
+  }
+
+  if (is_blocked && !was_blocked) {
+    _ghost_count++;
+    Log.traceln(F("MATRIX: matrix %d blocked a possible ghost key"), _id);
+  }
+}
+
+void ButtonMatrix::debounce() {
+  for (uint8_t row = 0; row < _row_count; row++) {
+    uint16_t changed = (_raw[row] ^ _state[row]) & ~_blocked[row];
+    for (uint8_t col = 0; col < _col_count; col++) {
+      if (changed & ((uint16_t)1 << col)) {
+        if (++_counter[row][col] >= _debounce_scans) {
+          _state[row] ^= ((uint16_t)1 << col);
+          _counter[row][col] = 0;
+        }
+      } else {
+        _counter[row][col] = 0;
+      }
+    }
+  }
+}
+
+void ButtonMatrix::scan() {
+  unsigned long start = micros();
+
+  // scans run on a fixed schedule, not a fixed gap after the last one
+  if ((long)(start - _next_scan) < 0) {
+    return;
+  }
+
+  unsigned long late = start - _next_scan;
+  if (late > _scan_late_max) {
+    _scan_late_max = late;
+  }
+  if (late >= _scan_us) {
+    // fallen a whole period behind (e.g. a blocking send), resynchronise
+    _next_scan = start;
+  }
+  _next_scan += _scan_us;
+
+  read_raw();
+  if (!_diodes) {
+    block_ghosts();
+  }
+  debounce();
+
+  unsigned long scan_time = micros() - start;
+  if (scan_time > _scan_time_max) {
+    _scan_time_max = scan_time;
+  }
+}
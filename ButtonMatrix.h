@@ -0,0 +1,68 @@
+#ifndef _ButtonMatrix_H
+#define _ButtonMatrix_H
+
+#include <Arduino.h>
+
+// matrix size limits (one uint16_t of columns per row)
+#define MATRIX_MAX_ROWS 16
+#define MATRIX_MAX_COLS 16
+// time for a row to settle after being driven, before the columns are read
+#define MATRIX_SETTLE_US 3
+// rough time to read one column (digitalRead on an AVR), for checking that a
+// whole scan fits in scan_us
+#define MATRIX_READ_US 6
+
+// ButtonMatrix - a row/column key matrix, scanned at a fixed rate with per-key
+// debounce and (for matrices without diodes) ghost blocking
+class ButtonMatrix
+{
+private:
+  const int _id;
+  uint8_t _row_pins[MATRIX_MAX_ROWS];
+  uint8_t _col_pins[MATRIX_MAX_COLS];
+  const uint8_t _row_count;
+  const uint8_t _col_count;
+  const unsigned long _scan_us;
+  const uint8_t _debounce_scans;
+  const bool _diodes;
+
+  // last raw scan, debounced state and keys blocked as possible ghosts (bit
+  // per column, 1 = closed)
+  uint16_t _raw[MATRIX_MAX_ROWS];
+  uint16_t _state[MATRIX_MAX_ROWS];
+  uint16_t _blocked[MATRIX_MAX_ROWS];
+  // consecutive scans each key's raw value has differed from its state
+  uint8_t _counter[MATRIX_MAX_ROWS][MATRIX_MAX_COLS];
+
+  // scan timing/statistics
+  unsigned long _next_scan;
+  unsigned long _scan_time_max;
+  unsigned long _scan_late_max;
+  unsigned long _ghost_count;
+
+  void read_raw();
+  void block_ghosts();
+  void debounce();
+
+public:
+  ButtonMatrix(const int id, const uint8_t *row_pins, const uint8_t row_count, const uint8_t *col_pins, const uint8_t col_count, const unsigned long scan_us, const unsigned long debounce_ms, const bool diodes);
+
+  // accessors
+  int id();
+
+  // debounced key state (true if pressed)
+  bool read(const unsigned int row, const unsigned int col);
+
+  // worst case press to event time given the scan rate, debounce and the
+  // longest scan/lateness measured so far
+  unsigned long worst_case_latency_us();
+  unsigned long scan_time_max_us();
+  unsigned long scan_late_max_us();
+  unsigned long ghost_count();
+
+  // eventloop functions
+  void begin();
+  void scan();
+};
+
+#endif
@@ -1,40 +1,142 @@
 #include <ArduinoLog.h>
 #include <EthernetUdp.h>
 #include "ButtonOSC.h"
+#include "ConfigDiff.h"
 #include "network.h"
 
 EthernetUDP eth_udp;
+ArmedSocket eth_sntp_socket;
 #ifdef ARDUINO_UNOR4_WIFI
 WiFiUDP wifi_udp;
+WiFiUDP wifi_sntp_udp;
 #endif
+// whether the OSC socket was opened (available() is the size of the last
+// received packet, so can't be used to tell if we can send)
+static bool udp_ready = false;
+// counters for sends through the shared socket
+static unsigned long shared_packets = 0;
+static unsigned long shared_errors = 0;
+
+// OSC packet
+OSCPacket::OSCPacket(OSCMessage &msg, const bool bundle) {
+  uint32_t size = msg.bytes();
+
+  length = 0;
+  capacity = size + (bundle ? OSC_BUNDLE_HEADER_SIZE : 0);
+  data = (uint8_t *)malloc(capacity);
+  if (data == NULL) {
+    capacity = 0;
+    return;
+  }
+  if (bundle) {
+    uint8_t header[OSC_BUNDLE_HEADER_SIZE] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', 0 };
+    header[16] = size >> 24;
+    header[17] = size >> 16;
+    header[18] = size >> 8;
+    header[19] = size;
+    write(header, sizeof(header));
+    set_timetag(NTP_IMMEDIATE);
+  }
+  msg.send(*this);
+  if (length != capacity) {
+    // not all of it fitted, so it can't be sent
+    free(data);
+    data = NULL;
+    length = 0;
+    capacity = 0;
+  }
+}
+
+bool OSCPacket::usable() {
+  return data != NULL;
+}
+
+void OSCPacket::set_timetag(const uint64_t timetag) {
+  for (int i = 0; i < 8; i++) {
+    data[OSC_TIMETAG_OFFSET + i] = timetag >> (56 - 8 * i);
+  }
+}
+
+OSCPacket::~OSCPacket() {
+  free(data);
+}
+
+size_t OSCPacket::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t OSCPacket::write(const uint8_t *buffer, size_t size) {
+  if (data == NULL) {
+    return 0;
+  }
+  size = min(size, (size_t)(capacity - length));
+  memcpy(data + length, buffer, size);
+  length += size;
+  return size;
+}
 
 static void onButtonClick(void *context) {
   OSCContext* osc_context = (OSCContext*)context;
+  OSCPacket* packet = osc_context->packet;
   unsigned long start = millis();
 
-  Log.trace(F("OSC: %s %u %s"), osc_context->server, (unsigned long)(osc_context->port), osc_context->string);
+  if (!packet) {
+    Log.errorln(F("OSC: no message for %s, unable to send"), osc_context->string);
+    return;
+  }
+
+  // timetagged targets get a bundle for press time + timetag_ms, so they all
+  // act on it together (until the clock is set, it is for "immediately")
+  if (osc_context->timetag_ms) {
+    SNTPClock* clock = osc_context->clock;
+    packet->set_timetag((clock && clock->synced()) ? clock->now() + SNTPClock::from_ms(osc_context->timetag_ms) : NTP_IMMEDIATE);
+    if (osc_context->armed) {
+      osc_context->armed->patch(OSC_TIMETAG_OFFSET, packet->data + OSC_TIMETAG_OFFSET, 8);
+    }
+  }
 
-  // create the OSC message
-  OSCMessage msg(osc_context->string);
+  Log.trace(F("OSC: %s %u %s"), osc_context->server, (unsigned long)(osc_context->port), osc_context->string);
 
-  // send the OSC message
-  if (osc_context->network_type == WIRED) {
-    if (!eth_udp.available()) {
+  // send the (pre-encoded) OSC message
+  if (osc_context->stream) {
+    // queued, and written out as soon as the connection allows
+    if (!osc_context->stream->send(packet->data, packet->length)) {
+      Log.errorln(F("OSC: stream queue full, message dropped"));
+    }
+  } else if (osc_context->network_type == WIRED) {
+    if (osc_context->armed && osc_context->armed->fire()) {
+      // the packet was already staged in the chip, it only needed sending
+    } else if (osc_context->socket) {
+      // dedicated socket, the destination is already set
+      if (!osc_context->socket->send(packet->data, packet->length)) {
+        Log.errorln(F("OSC: send failed"));
+      }
+    } else if (!udp_ready) {
       Log.errorln(F("OSC: UDP is not available, unable to send"));
     } else {
       eth_udp.beginPacket(*(osc_context->server_ip), osc_context->port);
-      msg.send(eth_udp);
-      eth_udp.endPacket();
+      eth_udp.write(packet->data, packet->length);
+      if (eth_udp.endPacket()) {
+        shared_packets++;
+      } else {
+        shared_errors++;
+        Log.errorln(F("OSC: send failed"));
+      }
     }
   }
 #ifdef ARDUINO_UNOR4_WIFI 
   else if (osc_context->network_type == WIRELESS) {
-    if (!wifi_udp.available()) {
+    if (!udp_ready) {
       Log.errorln(F("OSC: UDP is not available, unable to send"));
     } else {
       wifi_udp.beginPacket(*(osc_context->server_ip), osc_context->port);
-      msg.send(wifi_udp);
-      wifi_udp.endPacket();
+      wifi_udp.write(packet->data, packet->length);
+      if (wifi_udp.endPacket()) {
+        shared_packets++;
+      } else {
+        shared_errors++;
+        Log.errorln(F("OSC: send failed"));
+      }
     }
   }
 #endif
@@ -42,52 +144,508 @@ static void onButtonClick(void *context) {
 }
 
 ButtonOSC::ButtonOSC(Config* config, NetworkType network_type) : _config(config) {
-  // setup buttons
-  _buttons = (Button**)malloc(sizeof(Button*) * _config->button_count);
+  _network_type = network_type;
+  _reload_requested = false;
+  _reload_json = NULL;
+
+  // create socket for OSC
+  if (network_type == WIRED) {
+    udp_ready = eth_udp.begin(54000);
+  }
+#ifdef ARDUINO_UNOR4_WIFI
+  else if (network_type == WIRELESS) {
+    udp_ready = wifi_udp.begin(54000);
+  }
+#endif
+  if (!udp_ready) {
+    Log.errorln(F("OSC: unable to open UDP socket"));
+  }
+
+  // keep a clock in step with the time server (for timetagged targets)
+  _clock = NULL;
+  IPAddress *time_server = config->time ? ip_str_to_address(config->time->server) : NULL;
+  if (time_server && network_type != NONE) {
+    UDP *sntp_udp = &eth_sntp_socket;
+    ArmedSocket *sntp_socket = &eth_sntp_socket;
+#ifdef ARDUINO_UNOR4_WIFI
+    if (network_type == WIRELESS) {
+      sntp_udp = &wifi_sntp_udp;
+      sntp_socket = NULL;
+    }
+#endif
+    _clock = new SNTPClock(sntp_udp, sntp_socket, *time_server, config->time->port, config->time->poll_ms);
+    if (!_clock->begin()) {
+      delete _clock;
+      _clock = NULL;
+    }
+  }
+  delete time_server;
+
+  // resolve each target once
+  _target_ips = (IPAddress**)malloc(sizeof(IPAddress*) * _config->target_count);
+  for (int i = 0; i < _config->target_count; i++) {
+    _target_ips[i] = ip_str_to_address(config->targets[i]->server);
+  }
+
+  // TCP targets keep a connection open for every send, so (on the W5x00) they
+  // get first pick of the pool
+  _socket_pool = (network_type == WIRED) ? new SocketPool(_clock ? 2 : 1) : NULL;
+  _target_sockets = (TargetSocket**)malloc(sizeof(TargetSocket*) * _config->target_count);
+  _target_streams = (TargetStream**)malloc(sizeof(TargetStream*) * _config->target_count);
+  for (int i = 0; i < _config->target_count; i++) {
+    _target_sockets[i] = NULL;
+    _target_streams[i] = NULL;
+    open_stream(i);
+  }
+
+  // encode each button's message once and (on the W5x00) give buttons marked
+  // 'prearm' a socket with it kept staged, so they get the next pick
+  _packets = (OSCPacket**)malloc(sizeof(OSCPacket*) * _config->button_count);
+  _armed_sockets = (ArmedSocket**)malloc(sizeof(ArmedSocket*) * _config->button_count);
   for (int i = 0; i < _config->button_count; i++) {
-    Log.traceln(F("BUTTON: Creating button %d/%d"), i, _config->button_count);
-
-    // get the configuration
-    ConfigButton* button = config->buttons[i];
-    ConfigTarget* target = config->targets[button->target];
-    
-    // setup the OSC context
-    OSCContext* osc_context = new OSCContext();
-    osc_context->server = target->server;
-    osc_context->server_ip = ip_str_to_address(target->server);
-    osc_context->port = target->port;
-    osc_context->string = button->osc_string;
-    osc_context->network_type = network_type;
-    
-    // create the button/led pair with associated callback
-    switch (button->button_type) {
-      case BUTTON_WIRED:
-        _buttons[i] = new WiredButton(i, button->button_pin, button->led_pin, (void *)osc_context, onButtonClick);
+    create_packet(i);
+    _armed_sockets[i] = NULL;
+    arm_button(i);
+  }
+
+  // give each UDP target its own hardware socket while there are enough, the
+  // rest share eth_udp
+  for (int i = 0; i < _config->target_count; i++) {
+    open_target(i);
+  }
+
+  // setup buses (before the buttons that read from them)
+  _buses = (ButtonBus**)malloc(sizeof(ButtonBus*) * _config->bus_count);
+  for (int i = 0; i < _config->bus_count; i++) {
+    Log.traceln(F("BUS: Creating bus %d/%d"), i, _config->bus_count);
+
+    ConfigBus* bus = config->buses[i];
+    switch (bus->bus_type) {
+      case BUS_SHIFTREG:
+        _buses[i] = new ShiftRegisterBus(i, bus->cs_pin, bus->chip_count, bus->clock, bus->scan_ms, bus->intr_pin);
+        break;
+      case BUS_MCP23017:
+        _buses[i] = new MCP23017Bus(i, bus->address, bus->chip_count, bus->clock, bus->scan_ms, bus->intr_pin);
         break;
-      case BUTTON_WIRELESS:
-        _buttons[i] = new WirelessButton(i, button->button_intr, button->button_code, button->led_pin, (void *)osc_context, onButtonClick);
+      case BUS_MCP23S17:
+        _buses[i] = new MCP23S17Bus(i, bus->cs_pin, bus->address, bus->chip_count, bus->clock, bus->scan_ms, bus->intr_pin);
         break;
-      default:
-        Log.errorln(F("BUTTON: invalid button type: %d"), button->button_type);
     }
+    _buses[i]->begin();
   }
 
-  // setup heartbeat
-  _heartbeat_led = new ezLED(config->misc->heartbeat_pin);
+  // setup matrices
+  _matrices = (ButtonMatrix**)malloc(sizeof(ButtonMatrix*) * _config->matrix_count);
+  for (int i = 0; i < _config->matrix_count; i++) {
+    Log.traceln(F("MATRIX: Creating matrix %d/%d"), i, _config->matrix_count);
 
-  // create socket for OSC
-  if (network_type == WIRED) {
-    eth_udp.begin(54000);
+    ConfigMatrix* matrix = config->matrices[i];
+    _matrices[i] = new ButtonMatrix(i, matrix->row_pins, matrix->row_count, matrix->col_pins, matrix->col_count, matrix->scan_us, matrix->debounce_ms, matrix->diodes);
+    _matrices[i]->begin();
+  }
+
+  // receivers are created as the wireless buttons that use them are
+  _receiver_count = 0;
+
+  // setup buttons (each with its LED, plus one for the heartbeat)
+  LEDs.reserve(_config->button_count + 1);
+  _contexts = (OSCContext**)malloc(sizeof(OSCContext*) * _config->button_count);
+  _buttons = (Button**)malloc(sizeof(Button*) * _config->button_count);
+  for (int i = 0; i < _config->button_count; i++) {
+    _contexts[i] = new OSCContext();
+    setup_context(i);
+    create_button(i);
+  }
+
+  // setup heartbeat (pulsed by the LED engine from here on)
+  _heartbeat_led = LEDs.add(config->misc->heartbeat_pin);
+  LEDs.fade(_heartbeat_led, 5, 30, 2000, true);
+
+  _last_stats = millis();
+  _last_command_poll = millis();
+}
+
+void ButtonOSC::create_packet(const int i) {
+  ConfigButton* button = _config->buttons[i];
+  ConfigTarget* target = _config->targets[button->target];
+
+  // timetagged targets get the message in a bundle
+  OSCMessage msg(button->osc_string);
+  _packets[i] = new OSCPacket(msg, target->timetag_ms > 0);
+  if (_packets[i] && !_packets[i]->usable()) {
+    delete _packets[i];
+    _packets[i] = NULL;
+  }
+  if (!_packets[i]) {
+    // left NULL, so a reload tries again
+    Log.errorln(F("BUTTON: unable to allocate the message for button %d"), i);
+  }
+  if (target->timetag_ms > 0 && !_clock) {
+    Log.errorln(F("TARGET: %d is timetagged, but there is no time server"), button->target);
+  }
+}
+
+void ButtonOSC::arm_button(const int i) {
+  ConfigButton* button = _config->buttons[i];
+  ConfigTarget* target = _config->targets[button->target];
+
+  if (button->prearm && _packets[i] && _socket_pool && _target_ips[button->target] && !_target_streams[button->target]) {
+    _armed_sockets[i] = _socket_pool->open_armed(*(_target_ips[button->target]), target->port, _packets[i]->data, _packets[i]->length);
+    if (_armed_sockets[i]) {
+      Log.traceln(F("BUTTON: %d is armed on socket %d"), i, _armed_sockets[i]->socket());
+    } else {
+      Log.errorln(F("BUTTON: no socket left to arm button %d"), i);
+    }
+  }
+}
+
+void ButtonOSC::open_stream(const int i) {
+  ConfigTarget* target = _config->targets[i];
+
+  if (target->transport != TRANSPORT_TCP || !_target_ips[i] || _network_type == NONE) {
+    return;
+  }
+
+  // TCP is only driven through the W5x00 socket registers - the WiFiS3's
+  // WiFiClient waits on the WiFi module to connect and write, which would
+  // stall button handling whenever the target is slow or down
+  if (_network_type == WIRELESS) {
+    Log.errorln(F("TARGET: %d uses 'tcp', which needs the Ethernet shield, using UDP"), i);
+    return;
+  }
+
+  if (_socket_pool) {
+    TCPSocket *socket = _socket_pool->open_tcp(*(_target_ips[i]), target->port);
+    if (socket) {
+      _target_streams[i] = new SocketStream(_socket_pool, socket);
+      Log.traceln(F("TARGET: %d uses TCP on socket %d"), i, socket->socket());
+    }
+  }
+  if (!_target_streams[i]) {
+    Log.errorln(F("TARGET: no socket left for a TCP connection to target %d, using UDP"), i);
+  }
+}
+
+void ButtonOSC::open_target(const int i) {
+  ConfigTarget* target = _config->targets[i];
+
+  if (_target_streams[i]) {
+    return;
+  }
+
+  if (_socket_pool && _target_ips[i]) {
+    _target_sockets[i] = _socket_pool->open(*(_target_ips[i]), target->port);
+  }
+  if (_target_sockets[i]) {
+    Log.traceln(F("TARGET: %d uses socket %d"), i, _target_sockets[i]->socket());
+  } else {
+    Log.traceln(F("TARGET: %d uses the shared socket"), i);
+  }
+}
+
+void ButtonOSC::setup_context(const int i) {
+  ConfigButton* button = _config->buttons[i];
+  ConfigTarget* target = _config->targets[button->target];
+
+  // setup the OSC context
+  OSCContext* osc_context = _contexts[i];
+  osc_context->server = target->server;
+  osc_context->server_ip = _target_ips[button->target];
+  osc_context->port = target->port;
+  osc_context->string = button->osc_string;
+  osc_context->network_type = _network_type;
+  osc_context->socket = _target_sockets[button->target];
+  osc_context->armed = _armed_sockets[i];
+  osc_context->stream = _target_streams[button->target];
+  osc_context->packet = _packets[i];
+  osc_context->clock = _clock;
+  osc_context->timetag_ms = target->timetag_ms;
+}
+
+void ButtonOSC::create_button(const int i) {
+  Log.traceln(F("BUTTON: Creating button %d/%d"), i, _config->button_count);
+
+  // get the configuration
+  ConfigButton* button = _config->buttons[i];
+  void* osc_context = (void *)_contexts[i];
+
+  // create the button/led pair with associated callback
+  switch (button->button_type) {
+    case BUTTON_WIRED:
+      _buttons[i] = new WiredButton(i, button->button_pin, button->led_pin, osc_context, onButtonClick);
+      break;
+    case BUTTON_WIRELESS:
+      _buttons[i] = new WirelessButton(i, add_receiver(button->button_intr), button->button_code, button->led_pin, osc_context, onButtonClick);
+      break;
+    case BUTTON_BUS:
+      if (button->bus >= (unsigned int)_config->bus_count) {
+        Log.errorln(F("BUTTON: invalid bus for button %d: %d"), i, button->bus);
+        while(1);
+      }
+      _buttons[i] = new BusButton(i, _buses[button->bus], button->button_input, button->led_pin, osc_context, onButtonClick);
+      break;
+    case BUTTON_MATRIX:
+      if (button->matrix >= (unsigned int)_config->matrix_count) {
+        Log.errorln(F("BUTTON: invalid matrix for button %d: %d"), i, button->matrix);
+        while(1);
+      }
+      _buttons[i] = new MatrixButton(i, _matrices[button->matrix], button->button_row, button->button_col, button->led_pin, osc_context, onButtonClick);
+      break;
+    default:
+      Log.errorln(F("BUTTON: invalid button type: %d"), button->button_type);
+  }
+}
+
+RFReceiver *ButtonOSC::add_receiver(const unsigned int interrupt) {
+  // wireless buttons on the same interrupt share a receiver
+  RFReceiver *receiver = this->receiver(interrupt);
+  if (receiver) {
+    return receiver;
+  }
+
+  if (_receiver_count == RF_MAX_RECEIVERS) {
+    Log.errorln(F("RF: too many receivers (max %d)"), RF_MAX_RECEIVERS);
+    while(1);
+  }
+  Log.traceln(F("RF: Creating receiver on interrupt %d"), interrupt);
+  receiver = new RFReceiver(interrupt);
+  receiver->begin();
+  _receivers[_receiver_count++] = receiver;
+  return receiver;
+}
+
+// grows/shrinks a per button/target array, new entries start out NULL
+static void *resize(void *array, const int count, const int new_count, const size_t size) {
+  array = realloc(array, size * max(new_count, 1));
+  if (array == NULL) {
+    Log.errorln(F("CONFIG: Unable to allocate memory for reload"));
+    while(1);
+  }
+  if (new_count > count) {
+    memset((uint8_t *)array + size * count, 0, size * (new_count - count));
+  }
+  return array;
+}
+
+bool ButtonOSC::reload(Config *config) {
+  unsigned long start = millis();
+  Config *running = _config;
+
+  ConfigDiff diff(running, config);
+  Log.traceln(diff.to_string().c_str());
+  if (diff.restart) {
+    Log.errorln(F("CONFIG: misc, network, time, bus or matrix settings have changed, restart to apply them"));
+    return false;
+  }
+
+  // take down what has changed or gone first, so its sockets can be reused
+  for (int i = 0; i < running->button_count; i++) {
+    bool removed = (i >= config->button_count);
+    uint8_t changed = removed ? 0xFF : diff.buttons[i];
+
+    if (_armed_sockets[i] && (changed & (DIFF_BUTTON_MESSAGE | DIFF_BUTTON_TARGET))) {
+      _socket_pool->close(_armed_sockets[i]);
+      _armed_sockets[i] = NULL;
+    }
+    if (changed & DIFF_BUTTON_INPUT) {
+      if (removed) {
+        _buttons[i]->led_off();
+      }
+      delete _buttons[i];
+      _buttons[i] = NULL;
+    }
+    if (changed & (DIFF_BUTTON_MESSAGE | DIFF_BUTTON_TARGET)) {
+      delete _packets[i];
+      _packets[i] = NULL;
+    }
+    if (removed) {
+      delete _contexts[i];
+    }
+  }
+  for (int i = 0; i < running->target_count; i++) {
+    if (i >= config->target_count || diff.targets[i]) {
+      if (_target_sockets[i]) {
+        _socket_pool->close(_target_sockets[i]);
+        _target_sockets[i] = NULL;
+      }
+      delete _target_streams[i];
+      _target_streams[i] = NULL;
+      delete _target_ips[i];
+      _target_ips[i] = NULL;
+    }
   }
+
+  // size everything for the new configuration (each rebuilt button could
+  // bring a new LED)
+  LEDs.reserve(LEDs.count() + diff.buttons_changed);
+  _buttons = (Button**)resize(_buttons, running->button_count, config->button_count, sizeof(Button*));
+  _contexts = (OSCContext**)resize(_contexts, running->button_count, config->button_count, sizeof(OSCContext*));
+  _packets = (OSCPacket**)resize(_packets, running->button_count, config->button_count, sizeof(OSCPacket*));
+  _armed_sockets = (ArmedSocket**)resize(_armed_sockets, running->button_count, config->button_count, sizeof(ArmedSocket*));
+  _target_ips = (IPAddress**)resize(_target_ips, running->target_count, config->target_count, sizeof(IPAddress*));
+  _target_sockets = (TargetSocket**)resize(_target_sockets, running->target_count, config->target_count, sizeof(TargetSocket*));
+  _target_streams = (TargetStream**)resize(_target_streams, running->target_count, config->target_count, sizeof(TargetStream*));
+  _config = config;
+
+  // bring up what has changed, in the same order as at startup
+  for (int i = 0; i < config->target_count; i++) {
+    if (diff.targets[i]) {
+      _target_ips[i] = ip_str_to_address(config->targets[i]->server);
+      open_stream(i);
+    }
+  }
+  for (int i = 0; i < config->button_count; i++) {
+    if (!_packets[i]) {
+      create_packet(i);
+    }
+    if (!_armed_sockets[i] && (diff.buttons[i] & (DIFF_BUTTON_MESSAGE | DIFF_BUTTON_TARGET))) {
+      arm_button(i);
+    }
+  }
+  for (int i = 0; i < config->target_count; i++) {
+    if (diff.targets[i]) {
+      open_target(i);
+    }
+  }
+
+  // every context is refreshed, as they point into the configuration
+  for (int i = 0; i < config->button_count; i++) {
+    if (!_contexts[i]) {
+      _contexts[i] = new OSCContext();
+    }
+    setup_context(i);
+    if (!_buttons[i]) {
+      create_button(i);
+    }
+  }
+
+  Log.traceln(F("CONFIG: reloaded in %ums"), millis() - start);
+  return true;
+}
+
+SNTPClock *ButtonOSC::clock() {
+  return _clock;
+}
+
+RFReceiver *ButtonOSC::receiver(const unsigned int interrupt) {
+  for (int i = 0; i < _receiver_count; i++) {
+    if (_receivers[i]->interrupt() == interrupt) {
+      return _receivers[i];
+    }
+  }
+  return NULL;
+}
+
+TargetStream *ButtonOSC::stream(const int target) {
+  return (target >= 0 && target < _config->target_count) ? _target_streams[target] : NULL;
+}
+
+ButtonMatrix *ButtonOSC::matrix(const int id) {
+  return (id >= 0 && id < _config->matrix_count) ? _matrices[id] : NULL;
+}
+
+bool ButtonOSC::reload_requested(const char **json) {
+  if (!_reload_requested) {
+    return false;
+  }
+
+  _reload_requested = false;
+  *json = _reload_json;
+  return true;
+}
+
+void ButtonOSC::poll_commands() {
+  if (!udp_ready || (millis() - _last_command_poll) < COMMAND_POLL_MS) {
+    return;
+  }
+  _last_command_poll = millis();
+
+  // read the whole command in one go
+  UDP *udp = &eth_udp;
 #ifdef ARDUINO_UNOR4_WIFI
-  else if (network_type = WIRELESS) {
-    wifi_udp.begin(54000);
+  if (_network_type == WIRELESS) {
+    udp = &wifi_udp;
   }
 #endif
+  int size = udp->parsePacket();
+  if (size <= 0) {
+    return;
+  }
+  if (size > COMMAND_MAX_SIZE) {
+    Log.errorln(F("OSC: command too large (%d bytes, max %d)"), size, COMMAND_MAX_SIZE);
+    return;
+  }
+  uint8_t *buffer = (uint8_t *)malloc(size);
+  if (buffer == NULL) {
+    // the rest of the packet is skipped by the next parsePacket()
+    Log.errorln(F("OSC: command too large (%d bytes)"), size);
+    return;
+  }
+  size = udp->read(buffer, size);
+
+  OSCMessage msg;
+  msg.fill(buffer, size);
+  free(buffer);
+  if (msg.hasError()) {
+    Log.errorln(F("OSC: invalid command"));
+    return;
+  }
+
+  if (msg.fullMatch(COMMAND_RELOAD)) {
+    // the inline document is kept until the next request
+    free(_reload_json);
+    _reload_json = NULL;
+    if (msg.isString(0)) {
+      int length = msg.getDataLength(0);
+      _reload_json = (char *)malloc(length);
+      if (_reload_json == NULL) {
+        Log.errorln(F("OSC: reload too large (%d bytes)"), length);
+        return;
+      }
+      msg.getString(0, _reload_json, length);
+    }
+    Log.traceln(F("OSC: reload requested (%s)"), _reload_json ? "inline" : "file");
+    _reload_requested = true;
+  } else {
+    Log.errorln(F("OSC: unknown command"));
+  }
+}
+
+void ButtonOSC::log_stats() {
+  Log.traceln(F("OSC: shared socket packets=%u errors=%u"), shared_packets, shared_errors);
+  if (_socket_pool) {
+    _socket_pool->log_stats();
+  }
+  for (int i = 0; i < _config->target_count; i++) {
+    if (_target_streams[i]) {
+      _target_streams[i]->log_stats();
+    }
+  }
+  if (_clock) {
+    _clock->log_stats();
+  }
+  for (int i = 0; i < _receiver_count; i++) {
+    _receivers[i]->log_stats();
+  }
 }
 
 void ButtonOSC::loop() {
-  // handle button/LED loops 
+  // read each bus in one burst (a no-op unless a scan is due)
+  for (int i = 0; i < _config->bus_count; i++) {
+    _buses[i]->scan();
+  }
+
+  // scan the matrices (a no-op until the next scan is due)
+  for (int i = 0; i < _config->matrix_count; i++) {
+    _matrices[i]->scan();
+  }
+
+  // decode what the receivers picked up since the last loop
+  for (int i = 0; i < _receiver_count; i++) {
+    _receivers[i]->decode();
+  }
+
+  // handle button loops
   for (int i = 0; i < _config->button_count; i++) {
     _buttons[i]->loop();
   }
@@ -97,16 +655,32 @@ void ButtonOSC::loop() {
     _buttons[i]->reset();
   }
 
-  // pulse the hb LED
-  static bool is_faded_in = false;
-  if (_heartbeat_led->getState() == LED_IDLE) {
-    if (is_faded_in == false) {
-      _heartbeat_led->fade(5, 30, 2000);
-      is_faded_in = true;
-    } else {
-      _heartbeat_led->fade(30, 5, 2000);
-      is_faded_in = false;
+  // drive the button and heartbeat LEDs (a no-op until a change is due)
+  LEDs.loop();
+
+  // commands (a no-op until the next poll is due)
+  poll_commands();
+
+  // keep the clock in step (a no-op until the next request is due)
+  if (_clock) {
+    _clock->loop();
+  }
+
+  // keep the TCP connections up, and write out what they have queued
+  for (int i = 0; i < _config->target_count; i++) {
+    if (_target_streams[i]) {
+      _target_streams[i]->loop();
     }
   }
-  _heartbeat_led->loop();
+
+  // re-arm any sockets that have sent
+  if (_socket_pool) {
+    _socket_pool->loop();
+  }
+
+  // periodic send statistics
+  if ((millis() - _last_stats) >= STATS_INTERVAL_MS) {
+    _last_stats = millis();
+    log_stats();
+  }
 }
@@ -1,18 +1,41 @@
-#include <ezLED.h>
 #include <OSCMessage.h>
 #include "Button.h"
 #include "Config.h"
+#include "LEDEngine.h"
+#include "SNTPClock.h"
+#include "TargetSocket.h"
+#include "TargetStream.h"
 #include "network.h"
 
-class ButtonOSC {
-  private:
-    Button **_buttons;
-    ezLED *_heartbeat_led;
-    Config *_config;
+// how often the send statistics are logged
+#define STATS_INTERVAL_MS 60000
+// how often the OSC socket is checked for commands
+#define COMMAND_POLL_MS 20
+// reloads the configuration, from the (string) argument or the SD file
+#define COMMAND_RELOAD "/buttonosc/reload"
+// largest command taken (a UDP datagram that fits one Ethernet frame, the
+// W5x00 doesn't reassemble fragments)
+#define COMMAND_MAX_SIZE 1472
 
+// a bundle is "#bundle", the timetag, then the message's size and the message
+#define OSC_BUNDLE_HEADER_SIZE 20
+#define OSC_TIMETAG_OFFSET 8
+
+// OSCPacket - an OSC message encoded once, so a send is a single write. As a
+// bundle, only the timetag needs updating before each send.
+class OSCPacket : public Print {
   public:
-    ButtonOSC(Config *config, NetworkType network_type);
-    void loop();
+    uint8_t *data;
+    uint16_t length;
+    uint16_t capacity;
+
+    OSCPacket(OSCMessage &msg, const bool bundle = false);
+    ~OSCPacket();
+    // false if there wasn't the memory to encode the whole message
+    bool usable();
+    void set_timetag(const uint64_t timetag);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
 };
 
 struct OSCContext {
@@ -21,4 +44,71 @@ struct OSCContext {
   char *string;
   IPAddress *server_ip;
   NetworkType network_type;
-};
\ No newline at end of file
+  OSCPacket *packet;
+  TargetSocket *socket;
+  ArmedSocket *armed;
+  TargetStream *stream;
+  SNTPClock *clock;
+  unsigned long timetag_ms;
+};
+
+class ButtonOSC {
+  private:
+    Button **_buttons;
+    OSCContext **_contexts;
+    IPAddress **_target_ips;
+    TargetSocket **_target_sockets;
+    TargetStream **_target_streams;
+    SocketPool *_socket_pool;
+    OSCPacket **_packets;
+    ArmedSocket **_armed_sockets;
+    ButtonBus **_buses;
+    ButtonMatrix **_matrices;
+    RFReceiver *_receivers[RF_MAX_RECEIVERS];
+    int _receiver_count;
+    int _heartbeat_led;
+    SNTPClock *_clock;
+    Config *_config;
+    NetworkType _network_type;
+    unsigned long _last_stats;
+    unsigned long _last_command_poll;
+    bool _reload_requested;
+    char *_reload_json;
+
+    // per button/target setup (used at startup and on reload)
+    void create_packet(const int i);
+    void arm_button(const int i);
+    void open_target(const int i);
+    void open_stream(const int i);
+    void setup_context(const int i);
+    void create_button(const int i);
+    RFReceiver *add_receiver(const unsigned int interrupt);
+
+    void poll_commands();
+
+  public:
+    ButtonOSC(Config *config, NetworkType network_type);
+    void loop();
+    void log_stats();
+
+    // the clock kept by the time server (NULL if there isn't one)
+    SNTPClock *clock();
+
+    // the receiver on an interrupt (NULL if no wireless button uses it)
+    RFReceiver *receiver(const unsigned int interrupt);
+
+    // the connection to a target (NULL unless it is sent to over TCP)
+    TargetStream *stream(const int target);
+
+    // a configured matrix (NULL if there isn't one with that id)
+    ButtonMatrix *matrix(const int id);
+
+    // true (once) when a reload has been requested over OSC, with json set to
+    // the document sent with it or NULL to re-read the configuration file
+    bool reload_requested(const char **json);
+
+    // switches to a new configuration, rebuilding only the buttons and targets
+    // that changed (false, and nothing changed, if it needs a restart). The
+    // caller still owns both configurations.
+    bool reload(Config *config);
+};
@@ -1,7 +1,8 @@
 #include <ArduinoLog.h>
 #include <SD.h>
 #include <string.h>
-#include "config.h"
+#include "Config.h"
+#include "SNTPClock.h"
 
 String ConfigButton::to_string() {
   return String("Button(")
@@ -10,9 +11,15 @@ String ConfigButton::to_string() {
       + String(" button_pin=") + String(button_pin)
       + String(" button_intr=") + String(button_intr)
       + String(" button_code=") + String(button_code)
+      + String(" bus=") + String(bus)
+      + String(" button_input=") + String(button_input)
+      + String(" matrix=") + String(matrix)
+      + String(" button_row=") + String(button_row)
+      + String(" button_col=") + String(button_col)
       + String(" led_pin=") + String(led_pin)
       + String(" osc_string=") + String(osc_string ? osc_string : "")
       + String(" target=") + String(target)
+      + String(" prearm=") + String(prearm)
       + String(")");
 }
 
@@ -21,12 +28,55 @@ String ConfigTarget::to_string() {
       + String("id=") + String(id)
       + String(" server=") + String(server ? server : "")
       + String(" port=") + String(port)
+      + String(" timetag_ms=") + String(timetag_ms)
+      + String(" transport=") + String(transport)
+      + String(")");
+}
+
+String ConfigTime::to_string() {
+  return String("Time(")
+      + String("server=") + String(server ? server : "")
+      + String(" port=") + String(port)
+      + String(" poll_ms=") + String(poll_ms)
+      + String(")");
+}
+
+String ConfigBus::to_string() {
+  return String("Bus(")
+      + String("id=") + String(id)
+      + String(" bus_type=") + String(bus_type)
+      + String(" cs_pin=") + String(cs_pin)
+      + String(" intr_pin=") + String(intr_pin)
+      + String(" address=") + String(address)
+      + String(" chip_count=") + String(chip_count)
+      + String(" clock=") + String(clock)
+      + String(" scan_ms=") + String(scan_ms)
+      + String(")");
+}
+
+String ConfigMatrix::to_string() {
+  String _row_pins;
+  for (int i = 0; i < row_count; i++) {
+    _row_pins += String(i ? "," : "") + String(row_pins[i]);
+  }
+  String _col_pins;
+  for (int i = 0; i < col_count; i++) {
+    _col_pins += String(i ? "," : "") + String(col_pins[i]);
+  }
+  return String("Matrix(")
+      + String("id=") + String(id)
+      + String(" row_pins=") + _row_pins
+      + String(" col_pins=") + _col_pins
+      + String(" scan_us=") + String(scan_us)
+      + String(" debounce_ms=") + String(debounce_ms)
+      + String(" diodes=") + String(diodes)
       + String(")");
 }
 
 String ConfigMisc::to_string() {
   return String("Misc(")
       + String("heartbeat_pin=") + String(heartbeat_pin)
+      + String(" config_poll_ms=") + String(config_poll_ms)
       + String(")");
 }
 
@@ -60,6 +110,7 @@ String ConfigNetworkWifi::to_string() {
 String Config::to_string() {
   String _misc = misc->to_string() + String("\n");
   String _network = network->to_string() + String("\n");
+  String _time = time ? time->to_string() + String("\n") : String("");
   String _buttons;
   for (int i = 0; i < button_count; i++) {
     _buttons += buttons[i]->to_string();
@@ -70,7 +121,58 @@ String Config::to_string() {
     _targets += targets[i]->to_string();
     _targets += String("\n");
   }
-  return String("Config(\n") + _misc + _network + _buttons + _targets + String(")");
+  String _buses;
+  for (int i = 0; i < bus_count; i++) {
+    _buses += buses[i]->to_string();
+    _buses += String("\n");
+  }
+  String _matrices;
+  for (int i = 0; i < matrix_count; i++) {
+    _matrices += matrices[i]->to_string();
+    _matrices += String("\n");
+  }
+  return String("Config(\n") + _misc + _network + _time + _buttons + _targets + _buses + _matrices + String(")");
+}
+
+// Opens a file in the root directory of the SD card
+static bool open_sd_file(const char *filename, Sd2Card &card, SdVolume &volume, SdFile &root, SdFile &file) {
+  // initialise the SD card
+  if (!card.init(SPI_HALF_SPEED, 4)) {
+    Log.errorln(F("SD: Initialization failed!"));
+    return false;
+  }
+
+  // get the volume and root dir from the card
+  if (!volume.init(card)) {
+    Log.errorln(F("SD: Could not find FAT16/FAT32 partition on SD card"));
+    return false;
+  }
+  root.openRoot(volume);
+
+  // open the required configuration file
+  if (!file.open(root, filename)) {
+    Log.errorln(F("SD: Could not open file: %s"), filename);
+    return false;
+  }
+
+  return true;
+}
+
+// Gets a stamp (size and last write time) that changes when the file is rewritten
+static bool read_sd_stamp(const char *filename, uint32_t *stamp) {
+  Sd2Card card;
+  SdVolume volume;
+  SdFile root;
+  SdFile file;
+  dir_t entry;
+
+  if (!open_sd_file(filename, card, volume, root, file) || !file.dirEntry(&entry)) {
+    return false;
+  }
+  file.close();
+
+  *stamp = entry.fileSize ^ (((uint32_t)entry.lastWriteDate << 16) | entry.lastWriteTime);
+  return true;
 }
 
 // Loads the configuration from a file
@@ -84,32 +186,22 @@ const char *read_file_from_sd(const char *filename) {
   // tracing
   Log.traceln(F("CONFIG: Loading configuration from SD"));
 
-  // initialise the SD card
   Log.traceln(F("SD: Initializing SD card"));
-  if (!card.init(SPI_HALF_SPEED, 4)) {
-    Log.errorln(F("SD: Initialization failed!"));
-    while (1);
-  }
-
-  // get the volume and root dir from the card
-  if (!volume.init(card)) {
-    Log.errorln(F("SD: Could not find FAT16/FAT32 partition on SD card"));
-    while (1);
+  if (!open_sd_file(filename, card, volume, root, _config_file)) {
+    return NULL;
   }
-  root.openRoot(volume);
-  
-  // open the required configuration file
-  _config_file.open(root, filename);
   config_file = SDFile(_config_file, filename);
 
   // read the file into a string
   unsigned long size = config_file.size();
-  char *buffer = new char[size];
-  int error = config_file.read(buffer, size);
-  if (error) {
+  char *buffer = new char[size + 1];
+  if (config_file.read(buffer, size) != (int)size) {
     Log.errorln(F("SD Failed to read file: %s"), filename);
-    while(1);
+    config_file.close();
+    delete[] buffer;
+    return NULL;
   }
+  buffer[size] = 0;
 
   config_file.close();
 
@@ -138,18 +230,39 @@ char *Config::copy_value(JsonObject obj, const char *key)
   return dest;
 }
 
-void Config::parse_json()
+int Config::copy_pins(JsonObject obj, const char *key, uint8_t *pins, const uint8_t max_pins)
+{
+  JsonArray source = obj[key].as<JsonArray>();
+  int count = 0;
+
+  for (JsonVariant pin : source) {
+    if (count == max_pins) {
+      Log.errorln(F("CONFIG: too many pins in '%s' (max %d)"), key, max_pins);
+      return -1;
+    }
+    pins[count++] = pin.as<uint8_t>();
+  }
+
+  return count;
+}
+
+bool Config::parse_json()
 {
   int length;
 
   Log.traceln(F("CONFIG: Loading JSON"));
 
-  // read into the json doc
-  DynamicJsonDocument config_doc(2048);
+  if (buffer == NULL) {
+    Log.errorln(F("CONFIG: no JSON document to load"));
+    return false;
+  }
+
+  // read into the json doc (sized from the document so large panels fit)
+  DynamicJsonDocument config_doc(max((size_t)2048, strlen(buffer) * 3 / 2));
   DeserializationError error = deserializeJson(config_doc, buffer);
   if (error) {
     Log.errorln(F("CONFIG: failed to deserialize JSON"));
-    while(1);
+    return false;
   }
 
   // parse the json doc
@@ -160,44 +273,45 @@ void Config::parse_json()
        !json_root.containsKey("buttons") ||
        !json_root.containsKey("targets")) {
     Log.errorln(F("CONFIG: JSON document does exist or does not contain required keys: 'misc', 'buttons' and/or 'targets'"));
-    while(1);
+    return false;
   }
 
   // get the misc config
   JsonObject json_misc = json_root["misc"].as<JsonObject>();
   if (json_misc == nullptr) {
     Log.errorln(F("CONFIG: JSON document does not have a 'misc' object"));
-    while(1);
+    return false;
   }
 
-  misc = (ConfigMisc*)malloc(sizeof(ConfigMisc));
+  misc = (ConfigMisc*)calloc(1, sizeof(ConfigMisc));
   if (misc == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for misc config"));
-    while(1);
+    return false;
   }
   
   // copy the integer config
   misc->heartbeat_pin = json_misc["heartbeat_pin"];
+  misc->config_poll_ms = json_misc["config_poll_ms"] | 0;
 
   // get the network config
   JsonObject json_network = json_root["network"].as<JsonObject>();
   if (json_network == nullptr) {
     Log.errorln(F("CONFIG: JSON document does not have a 'network' object"));
-    while(1);
+    return false;
   }
 
   // network config
-  network = (ConfigNetwork*)malloc(sizeof(ConfigNetwork));
+  network = (ConfigNetwork*)calloc(1, sizeof(ConfigNetwork));
   if (network == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for network config"));
-    while(1);
+    return false;
   }
 
   // ethernet config
-  network->ethernet = (ConfigNetworkEthernet*)malloc(sizeof(ConfigNetworkEthernet));
+  network->ethernet = (ConfigNetworkEthernet*)calloc(1, sizeof(ConfigNetworkEthernet));
   if (network->ethernet == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for ethernet network config"));
-    while(1);
+    return false;
   }
 
   network->ethernet->mac = copy_value(json_network["ethernet"], "mac");
@@ -207,10 +321,10 @@ void Config::parse_json()
   network->ethernet->dns = copy_value(json_network["ethernet"], "dns");
 
   // WIFI config
-  network->wifi = (ConfigNetworkWifi*)malloc(sizeof(ConfigNetworkWifi));
+  network->wifi = (ConfigNetworkWifi*)calloc(1, sizeof(ConfigNetworkWifi));
   if (network->wifi == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for WIFI network config"));
-    while(1);
+    return false;
   }
 
   network->wifi->ssid = copy_value(json_network["wifi"], "ssid");
@@ -220,18 +334,32 @@ void Config::parse_json()
   network->wifi->gw = copy_value(json_network["wifi"], "gw");
   network->wifi->dns = copy_value(json_network["wifi"], "dns");
 
+  // get the time config (optional, only needed for timetagged targets)
+  JsonObject json_time = json_root["time"].as<JsonObject>();
+  if (json_time != nullptr) {
+    time = (ConfigTime*)calloc(1, sizeof(ConfigTime));
+    if (time == nullptr) {
+      Log.errorln(F("CONFIG: Unable to allocate memory for time config"));
+      return false;
+    }
+
+    time->server = copy_value(json_time, "server");
+    time->port = json_time["port"] | SNTP_PORT;
+    time->poll_ms = json_time["poll_ms"] | 16000;
+  }
+
   // get the buttons
   JsonArray json_buttons = json_root["buttons"].as<JsonArray>();
   if (json_buttons == nullptr) {
     Log.errorln(F("CONFIG: JSON document does not have a 'buttons' array"));
-    while(1);
+    return false;
   }
 
   button_count = json_buttons.size();
-  buttons = (ConfigButton**)malloc(button_count * sizeof(ConfigButton*));
+  buttons = (ConfigButton**)calloc(button_count, sizeof(ConfigButton*));
   if (buttons == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for buttons config"));
-    while(1);
+    return false;
   }
   
   int _button = 0;
@@ -240,7 +368,7 @@ void Config::parse_json()
     buttons[_button] = (ConfigButton*)malloc(sizeof(ConfigButton));
     if (buttons[_button] == nullptr) {
       Log.errorln(F("CONFIG: Unable to allocate memory for button"));
-      while(1);
+      return false;
     }
 
     // copy the integer values
@@ -249,16 +377,27 @@ void Config::parse_json()
     buttons[_button]->button_pin = obj["button_pin"];
     buttons[_button]->button_intr = obj["button_intr"];
     buttons[_button]->button_code = obj["button_code"];
+    buttons[_button]->bus = obj["bus"];
+    buttons[_button]->button_input = obj["button_input"];
+    buttons[_button]->matrix = obj["matrix"];
+    buttons[_button]->button_row = obj["button_row"];
+    buttons[_button]->button_col = obj["button_col"];
     buttons[_button]->target = obj["target"];
     buttons[_button]->osc_string = copy_value(obj, "osc_string");
+    buttons[_button]->prearm = obj["prearm"] | false;
 
     // get the button type
     if (strncmp(obj["button_type"], "wired", 5) == 0) {
       buttons[_button]->button_type = BUTTON_WIRED;
     } else if (strncmp(obj["button_type"], "wireless", 8) == 0) {
       buttons[_button]->button_type = BUTTON_WIRELESS;
+    } else if (strncmp(obj["button_type"], "bus", 3) == 0) {
+      buttons[_button]->button_type = BUTTON_BUS;
+    } else if (strncmp(obj["button_type"], "matrix", 6) == 0) {
+      buttons[_button]->button_type = BUTTON_MATRIX;
     } else {
       Log.errorln(F("CONFIG: Incorrect value for 'button_type' configuration"));
+      return false;
     }
 
     _button++;
@@ -268,14 +407,14 @@ void Config::parse_json()
   JsonArray json_targets = json_root["targets"].as<JsonArray>();
   if (json_targets == nullptr) {
     Log.errorln(F("CONFIG: JSON document does not have a 'targets' array"));
-    while(1);
+    return false;
   }
 
   target_count = json_targets.size();
-  targets = (ConfigTarget**)malloc(target_count * sizeof(ConfigTarget*));
+  targets = (ConfigTarget**)calloc(target_count, sizeof(ConfigTarget*));
   if (targets == nullptr) {
     Log.errorln(F("CONFIG: Unable to allocate memory for targets config"));
-    while(1);
+    return false;
   }
 
   int _target = 0;
@@ -284,27 +423,250 @@ void Config::parse_json()
     targets[_target] = (ConfigTarget*)malloc(sizeof(ConfigTarget));
     if (targets[_target] == nullptr) {
       Log.errorln(F("CONFIG: Unable to allocate memory for target"));
-      while(1);
+      return false;
     }
     
     // copy the target values
     targets[_target]->id = obj["id"];
     targets[_target]->port = obj["port"];
     targets[_target]->server = copy_value(obj, "server");
+    targets[_target]->timetag_ms = obj["timetag_ms"] | 0;
+
+    // get the transport
+    if (strncmp(obj["transport"] | "udp", "udp", 3) == 0) {
+      targets[_target]->transport = TRANSPORT_UDP;
+    } else if (strncmp(obj["transport"] | "", "tcp", 3) == 0) {
+      targets[_target]->transport = TRANSPORT_TCP;
+    } else {
+      Log.errorln(F("CONFIG: Incorrect value for 'transport' configuration"));
+      return false;
+    }
 
     _target++;
   }
 
+  // get the buses (optional, only needed for shift register/expander buttons)
+  JsonArray json_buses = json_root["buses"].as<JsonArray>();
+  bus_count = json_buses.size();
+  buses = (ConfigBus**)calloc(bus_count, sizeof(ConfigBus*));
+  if (bus_count > 0 && buses == nullptr) {
+    Log.errorln(F("CONFIG: Unable to allocate memory for buses config"));
+    return false;
+  }
+
+  int _bus = 0;
+  for (JsonObject obj : json_buses) {
+    // allocate space
+    buses[_bus] = (ConfigBus*)malloc(sizeof(ConfigBus));
+    if (buses[_bus] == nullptr) {
+      Log.errorln(F("CONFIG: Unable to allocate memory for bus"));
+      return false;
+    }
+
+    // copy the bus values
+    buses[_bus]->id = obj["id"];
+    buses[_bus]->cs_pin = obj["cs_pin"];
+    buses[_bus]->intr_pin = obj["intr_pin"] | BUS_NO_INTR;
+    buses[_bus]->address = obj["address"];
+    buses[_bus]->chip_count = obj["chip_count"] | 1;
+    buses[_bus]->scan_ms = obj["scan_ms"] | 1;
+
+    // get the bus type (and its default clock)
+    if (strncmp(obj["bus_type"] | "", "shiftreg", 8) == 0) {
+      buses[_bus]->bus_type = BUS_SHIFTREG;
+      buses[_bus]->clock = obj["clock"] | 4000000;
+    } else if (strncmp(obj["bus_type"] | "", "mcp23017", 8) == 0) {
+      buses[_bus]->bus_type = BUS_MCP23017;
+      buses[_bus]->clock = obj["clock"] | 400000;
+    } else if (strncmp(obj["bus_type"] | "", "mcp23s17", 8) == 0) {
+      buses[_bus]->bus_type = BUS_MCP23S17;
+      buses[_bus]->clock = obj["clock"] | 4000000;
+    } else {
+      Log.errorln(F("CONFIG: Incorrect value for 'bus_type' configuration"));
+      return false;
+    }
+
+    // a 74HC165 has no interrupt output, so a bus waiting on one is never read
+    if (buses[_bus]->bus_type == BUS_SHIFTREG && buses[_bus]->intr_pin != BUS_NO_INTR) {
+      Log.errorln(F("CONFIG: 'intr_pin' is only for expander buses, not 'shiftreg'"));
+      return false;
+    }
+
+    _bus++;
+  }
+
+  // get the matrices (optional, only needed for matrix buttons)
+  JsonArray json_matrices = json_root["matrices"].as<JsonArray>();
+  matrix_count = json_matrices.size();
+  matrices = (ConfigMatrix**)calloc(matrix_count, sizeof(ConfigMatrix*));
+  if (matrix_count > 0 && matrices == nullptr) {
+    Log.errorln(F("CONFIG: Unable to allocate memory for matrices config"));
+    return false;
+  }
+
+  int _matrix = 0;
+  for (JsonObject obj : json_matrices) {
+    // allocate space
+    matrices[_matrix] = (ConfigMatrix*)malloc(sizeof(ConfigMatrix));
+    if (matrices[_matrix] == nullptr) {
+      Log.errorln(F("CONFIG: Unable to allocate memory for matrix"));
+      return false;
+    }
+
+    // copy the matrix values
+    matrices[_matrix]->id = obj["id"];
+    int row_count = copy_pins(obj, "row_pins", matrices[_matrix]->row_pins, MATRIX_MAX_ROWS);
+    int col_count = copy_pins(obj, "col_pins", matrices[_matrix]->col_pins, MATRIX_MAX_COLS);
+    if (row_count < 0 || col_count < 0) {
+      return false;
+    }
+    matrices[_matrix]->row_count = row_count;
+    matrices[_matrix]->col_count = col_count;
+    matrices[_matrix]->scan_us = obj["scan_us"] | 1000;
+    matrices[_matrix]->debounce_ms = obj["debounce_ms"] | 5;
+    matrices[_matrix]->diodes = obj["diodes"] | false;
+
+    // a scan reads every row in one go, so it has to fit in the scan period
+    unsigned long scan_time = (unsigned long)row_count * (MATRIX_SETTLE_US + col_count * MATRIX_READ_US);
+    if (scan_time > matrices[_matrix]->scan_us) {
+      Log.errorln(F("CONFIG: matrix %d takes about %uus to scan, more than its 'scan_us' (%u)"), _matrix, scan_time, matrices[_matrix]->scan_us);
+      return false;
+    }
+
+    _matrix++;
+  }
+
+  // check the buttons only refer to things that exist
+  for (int i = 0; i < button_count; i++) {
+    ConfigButton *button = buttons[i];
+    if (button->target >= (unsigned int)target_count) {
+      Log.errorln(F("CONFIG: invalid target for button %d: %d"), i, button->target);
+      return false;
+    }
+    if (button->button_type == BUTTON_BUS && button->bus >= (unsigned int)bus_count) {
+      Log.errorln(F("CONFIG: invalid bus for button %d: %d"), i, button->bus);
+      return false;
+    }
+    if (button->button_type == BUTTON_MATRIX && button->matrix >= (unsigned int)matrix_count) {
+      Log.errorln(F("CONFIG: invalid matrix for button %d: %d"), i, button->matrix);
+      return false;
+    }
+  }
+
   // tracing
   Log.traceln(to_string().c_str());
   Log.traceln(F("CONFIG: Loading configuration (end)"));
+  return true;
 }
 
 Config::Config(const char *config, const bool read_from_sd)
 {
+  misc = NULL;
+  network = NULL;
+  time = NULL;
+  buttons = NULL;
+  targets = NULL;
+  buses = NULL;
+  matrices = NULL;
+  button_count = 0;
+  target_count = 0;
+  bus_count = 0;
+  matrix_count = 0;
+  filename = NULL;
+  file_stamp = 0;
+  last_poll = millis();
+
   if (read_from_sd) {
+    // remember the file (and how it looked) so changes can be picked up
+    filename = strdup(config);
+    read_sd_stamp(filename, &file_stamp);
     buffer = read_file_from_sd(config);
   } else {
+    // only used while parsing
     buffer = config;
   }
 }
+
+Config::~Config()
+{
+  if (network) {
+    if (network->ethernet) {
+      free(network->ethernet->mac);
+      free(network->ethernet->ip);
+      free(network->ethernet->mask);
+      free(network->ethernet->gw);
+      free(network->ethernet->dns);
+    }
+    if (network->wifi) {
+      free(network->wifi->ssid);
+      free(network->wifi->key);
+      free(network->wifi->ip);
+      free(network->wifi->mask);
+      free(network->wifi->gw);
+      free(network->wifi->dns);
+    }
+    free(network->ethernet);
+    free(network->wifi);
+  }
+  free(network);
+  free(misc);
+  if (time) {
+    free(time->server);
+  }
+  free(time);
+
+  for (int i = 0; buttons && i < button_count; i++) {
+    if (buttons[i]) {
+      free(buttons[i]->osc_string);
+    }
+    free(buttons[i]);
+  }
+  free(buttons);
+
+  for (int i = 0; targets && i < target_count; i++) {
+    if (targets[i]) {
+      free(targets[i]->server);
+    }
+    free(targets[i]);
+  }
+  free(targets);
+
+  for (int i = 0; buses && i < bus_count; i++) {
+    free(buses[i]);
+  }
+  free(buses);
+
+  for (int i = 0; matrices && i < matrix_count; i++) {
+    free(matrices[i]);
+  }
+  free(matrices);
+
+  if (filename) {
+    delete[] buffer;
+    free(filename);
+  }
+}
+
+const char *Config::file() {
+  return filename;
+}
+
+bool Config::file_changed() {
+  if (filename == NULL || misc == NULL || misc->config_poll_ms == 0) {
+    return false;
+  }
+  if ((millis() - last_poll) < misc->config_poll_ms) {
+    return false;
+  }
+  last_poll = millis();
+
+  // this re-initialises the card, so it stalls the loop for a moment
+  uint32_t stamp;
+  if (!read_sd_stamp(filename, &stamp) || stamp == file_stamp) {
+    return false;
+  }
+
+  Log.traceln(F("CONFIG: %s has changed"), filename);
+  file_stamp = stamp;
+  return true;
+}
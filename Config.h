@@ -3,6 +3,7 @@
 
 #include <ArduinoJson.h>
 #include "Button.h"
+#include "TargetStream.h"
 
 class ConfigButton {
   public:
@@ -11,9 +12,29 @@ class ConfigButton {
     unsigned int button_pin;
     unsigned int button_intr;
     unsigned long button_code;
+    unsigned int bus;
+    unsigned int button_input;
+    unsigned int matrix;
+    unsigned int button_row;
+    unsigned int button_col;
     ButtonType button_type;
     char *osc_string;
     unsigned int target;
+    bool prearm;
+
+    String to_string();
+};
+
+class ConfigBus {
+  public:
+    unsigned int id;
+    BusType bus_type;
+    unsigned int cs_pin;
+    int intr_pin;
+    unsigned int address;
+    unsigned int chip_count;
+    unsigned long clock;
+    unsigned long scan_ms;
 
     String to_string();
 };
@@ -23,6 +44,31 @@ class ConfigTarget {
     unsigned int id;
     char *server;
     unsigned int port;
+    unsigned long timetag_ms;
+    TargetTransport transport;
+
+    String to_string();
+};
+
+class ConfigMatrix {
+  public:
+    unsigned int id;
+    uint8_t row_pins[MATRIX_MAX_ROWS];
+    uint8_t row_count;
+    uint8_t col_pins[MATRIX_MAX_COLS];
+    uint8_t col_count;
+    unsigned long scan_us;
+    unsigned long debounce_ms;
+    bool diodes;
+
+    String to_string();
+};
+
+class ConfigTime {
+  public:
+    char *server;
+    unsigned int port;
+    unsigned long poll_ms;
 
     String to_string();
 };
@@ -30,6 +76,7 @@ class ConfigTarget {
 class ConfigMisc {
   public:
     unsigned int heartbeat_pin;
+    unsigned long config_poll_ms;
 
     String to_string();
 };
@@ -68,17 +115,33 @@ class ConfigNetwork {
 class Config {
   private:
     const char *buffer;
+    char *filename;
+    uint32_t file_stamp;
+    unsigned long last_poll;
   public:
     ConfigMisc *misc;
     ConfigNetwork *network;
+    ConfigTime *time;
     ConfigButton **buttons;
     ConfigTarget **targets;
+    ConfigBus **buses;
+    ConfigMatrix **matrices;
     int button_count;
     int target_count;
+    int bus_count;
+    int matrix_count;
 
     Config(const char *config, const bool read_from_sd);
-    void parse_json();
+    ~Config();
+    bool parse_json();
     char *copy_value(JsonObject obj, const char *key);
+    int copy_pins(JsonObject obj, const char *key, uint8_t *pins, const uint8_t max_pins);
+
+    // the SD file the configuration was read from (NULL if it wasn't)
+    const char *file();
+    // true if the SD file has changed since it was read (checked every
+    // misc.config_poll_ms, never if that is 0)
+    bool file_changed();
     String to_string();
 };
 
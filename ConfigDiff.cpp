@@ -0,0 +1,150 @@
+#include <string.h>
+#include "ConfigDiff.h"
+
+// compares two (possibly missing) strings
+static bool same_value(const char *a, const char *b) {
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+  return strcmp(a, b) == 0;
+}
+
+static bool same_input(ConfigButton *a, ConfigButton *b) {
+  return a->button_type == b->button_type
+      && a->button_pin == b->button_pin
+      && a->button_intr == b->button_intr
+      && a->button_code == b->button_code
+      && a->bus == b->bus
+      && a->button_input == b->button_input
+      && a->matrix == b->matrix
+      && a->button_row == b->button_row
+      && a->button_col == b->button_col
+      && a->led_pin == b->led_pin;
+}
+
+static bool same_target(ConfigTarget *a, ConfigTarget *b) {
+  return same_value(a->server, b->server)
+      && a->port == b->port
+      && a->timetag_ms == b->timetag_ms
+      && a->transport == b->transport;
+}
+
+static bool same_time(ConfigTime *a, ConfigTime *b) {
+  if (a == NULL || b == NULL) {
+    return a == b;
+  }
+  return same_value(a->server, b->server) && a->port == b->port && a->poll_ms == b->poll_ms;
+}
+
+static bool same_bus(ConfigBus *a, ConfigBus *b) {
+  return a->bus_type == b->bus_type
+      && a->cs_pin == b->cs_pin
+      && a->intr_pin == b->intr_pin
+      && a->address == b->address
+      && a->chip_count == b->chip_count
+      && a->clock == b->clock
+      && a->scan_ms == b->scan_ms;
+}
+
+static bool same_matrix(ConfigMatrix *a, ConfigMatrix *b) {
+  return a->row_count == b->row_count
+      && a->col_count == b->col_count
+      && memcmp(a->row_pins, b->row_pins, a->row_count) == 0
+      && memcmp(a->col_pins, b->col_pins, a->col_count) == 0
+      && a->scan_us == b->scan_us
+      && a->debounce_ms == b->debounce_ms
+      && a->diodes == b->diodes;
+}
+
+static bool same_network(ConfigNetwork *a, ConfigNetwork *b) {
+  return same_value(a->ethernet->mac, b->ethernet->mac)
+      && same_value(a->ethernet->ip, b->ethernet->ip)
+      && same_value(a->ethernet->mask, b->ethernet->mask)
+      && same_value(a->ethernet->gw, b->ethernet->gw)
+      && same_value(a->ethernet->dns, b->ethernet->dns)
+      && same_value(a->wifi->ssid, b->wifi->ssid)
+      && same_value(a->wifi->key, b->wifi->key)
+      && same_value(a->wifi->ip, b->wifi->ip)
+      && same_value(a->wifi->mask, b->wifi->mask)
+      && same_value(a->wifi->gw, b->wifi->gw)
+      && same_value(a->wifi->dns, b->wifi->dns);
+}
+
+// Config Diff
+ConfigDiff::ConfigDiff(Config *running, Config *next)
+{
+  buttons_changed = 0;
+  buttons_removed = max(running->button_count - next->button_count, 0);
+  targets_changed = 0;
+  targets_removed = max(running->target_count - next->target_count, 0);
+
+  // hardware and network settings
+  restart = running->misc->heartbeat_pin != next->misc->heartbeat_pin;
+  if (running->network && next->network) {
+    restart |= !same_network(running->network, next->network);
+  }
+  restart |= !same_time(running->time, next->time);
+  restart |= running->bus_count != next->bus_count;
+  for (int i = 0; !restart && i < next->bus_count; i++) {
+    restart |= !same_bus(running->buses[i], next->buses[i]);
+  }
+  restart |= running->matrix_count != next->matrix_count;
+  for (int i = 0; !restart && i < next->matrix_count; i++) {
+    restart |= !same_matrix(running->matrices[i], next->matrices[i]);
+  }
+
+  // targets
+  targets = (bool*)malloc(sizeof(bool) * max(next->target_count, 1));
+  for (int i = 0; i < next->target_count; i++) {
+    targets[i] = (i >= running->target_count) || !same_target(running->targets[i], next->targets[i]);
+    if (targets[i]) {
+      targets_changed++;
+    }
+  }
+
+  // buttons (after the targets, as a button follows a change to its target)
+  buttons = (uint8_t*)malloc(sizeof(uint8_t) * max(next->button_count, 1));
+  for (int i = 0; i < next->button_count; i++) {
+    ConfigButton *button = next->buttons[i];
+
+    if (i >= running->button_count) {
+      buttons[i] = DIFF_BUTTON_INPUT | DIFF_BUTTON_MESSAGE | DIFF_BUTTON_TARGET;
+    } else {
+      ConfigButton *old = running->buttons[i];
+      buttons[i] = 0;
+      if (!same_input(old, button)) {
+        buttons[i] |= DIFF_BUTTON_INPUT;
+      }
+      if (!same_value(old->osc_string, button->osc_string)) {
+        buttons[i] |= DIFF_BUTTON_MESSAGE;
+      }
+      if (old->target != button->target || targets[button->target] || old->prearm != button->prearm) {
+        buttons[i] |= DIFF_BUTTON_TARGET;
+      }
+    }
+
+    if (buttons[i]) {
+      buttons_changed++;
+    }
+  }
+}
+
+ConfigDiff::~ConfigDiff()
+{
+  free(buttons);
+  free(targets);
+}
+
+bool ConfigDiff::empty() {
+  return !restart && !buttons_changed && !buttons_removed && !targets_changed && !targets_removed;
+}
+
+String ConfigDiff::to_string() {
+  return String("Diff(")
+      + String("restart=") + String(restart)
+      + String(" buttons_changed=") + String(buttons_changed)
+      + String(" buttons_removed=") + String(buttons_removed)
+      + String(" targets_changed=") + String(targets_changed)
+      + String(" targets_removed=") + String(targets_removed)
+      + String(")");
+}
@@ -0,0 +1,32 @@
+#ifndef _ConfigDiff_H
+#define _ConfigDiff_H
+
+#include "Config.h"
+
+// what changed for a button (a new button has everything set)
+#define DIFF_BUTTON_INPUT 0x01    // type, input or LED, so the button is rebuilt
+#define DIFF_BUTTON_MESSAGE 0x02  // OSC string, so the packet is re-encoded
+#define DIFF_BUTTON_TARGET 0x04   // target (its address, timetag or transport) or prearm, so the send path changes
+
+// ConfigDiff - the differences between the running configuration and a new
+// one. Buttons and targets are compared by position, and anything that can
+// only change with a restart (misc, network, time, buses and matrices) sets
+// restart instead.
+class ConfigDiff {
+  public:
+    bool restart;
+    uint8_t *buttons;
+    bool *targets;
+    int buttons_changed;
+    int buttons_removed;
+    int targets_changed;
+    int targets_removed;
+
+    ConfigDiff(Config *running, Config *next);
+    ~ConfigDiff();
+
+    bool empty();
+    String to_string();
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include <ArduinoLog.h>
+#include "LEDEngine.h"
+
+// maximum number of distinct ports written in one batch
+#define LED_BATCH_PORTS 8
+
+LEDEngine LEDs;
+
+// LED Engine
+LEDEngine::LEDEngine()
+{
+  _pins = NULL;
+#ifdef LED_PORT_WRITES
+  _ports = NULL;
+  _masks = NULL;
+  _pwm = NULL;
+#endif
+  _pending = NULL;
+  _target = NULL;
+  _due = NULL;
+  _count = 0;
+  _size = 0;
+  _next_due = 0;
+  for (int i = 0; i < LED_MAX_FADES; i++) {
+    _fades[i].led = LED_NONE;
+  }
+}
+
+static void *grow(void *array, const int size, const size_t element) {
+  array = realloc(array, element * size);
+  if (array == NULL) {
+    Log.errorln(F("LED: unable to allocate memory for %d LEDs"), size);
+    while(1);
+  }
+  return array;
+}
+
+void LEDEngine::reserve(const int size) {
+  if (size <= _size) {
+    return;
+  }
+
+  _pins = (uint8_t *)grow(_pins, size, sizeof(uint8_t));
+#ifdef LED_PORT_WRITES
+  _ports = (volatile uint8_t **)grow(_ports, size, sizeof(volatile uint8_t *));
+  _masks = (uint8_t *)grow(_masks, size, sizeof(uint8_t));
+#endif
+  _target = (uint8_t *)grow(_target, size, sizeof(uint8_t));
+  _due = (unsigned long *)grow(_due, size, sizeof(unsigned long));
+  _pending = (uint32_t *)grow(_pending, LED_WORDS(size), sizeof(uint32_t));
+#ifdef LED_PORT_WRITES
+  _pwm = (uint32_t *)grow(_pwm, LED_WORDS(size), sizeof(uint32_t));
+#endif
+  for (int i = LED_WORDS(_size); i < LED_WORDS(size); i++) {
+    _pending[i] = 0;
+#ifdef LED_PORT_WRITES
+    _pwm[i] = 0;
+#endif
+  }
+  _size = size;
+}
+
+int LEDEngine::count() {
+  return _count;
+}
+
+int LEDEngine::add(const uint8_t pin) {
+  // LEDs can be shared between buttons
+  for (int i = 0; i < _count; i++) {
+    if (_pins[i] == pin) {
+      return i;
+    }
+  }
+
+  if (_count == _size) {
+    Log.errorln(F("LED: no room for the LED on pin %d (%d reserved)"), pin, _size);
+    while(1);
+  }
+
+  int led = _count++;
+  _pins[led] = pin;
+#ifdef LED_PORT_WRITES
+  _ports[led] = portOutputRegister(digitalPinToPort(pin));
+  _masks[led] = digitalPinToBitMask(pin);
+#endif
+  pinMode(pin, OUTPUT);
+  return led;
+}
+
+void LEDEngine::write(const int led, const bool on) {
+#ifdef LED_PORT_WRITES
+  if (_pwm[led >> 5] & (1UL << (led & 31))) {
+    // coming out of a fade, digitalWrite() turns the PWM off once
+    _pwm[led >> 5] &= ~(1UL << (led & 31));
+    digitalWrite(_pins[led], on ? HIGH : LOW);
+    return;
+  }
+  uint8_t sreg = SREG;
+  cli();
+  if (on) {
+    *_ports[led] |= _masks[led];
+  } else {
+    *_ports[led] &= ~_masks[led];
+  }
+  SREG = sreg;
+#else
+  digitalWrite(_pins[led], on ? HIGH : LOW);
+#endif
+}
+
+void LEDEngine::mark(const int led, const unsigned long due) {
+  bool scheduled = false;
+  for (int i = 0; i < LED_WORDS(_size); i++) {
+    scheduled |= (_pending[i] != 0);
+  }
+
+  _pending[led >> 5] |= (1UL << (led & 31));
+  _due[led] = due;
+  if (!scheduled || (long)(due - _next_due) < 0) {
+    _next_due = due;
+  }
+}
+
+void LEDEngine::unmark(const int led) {
+  // _next_due is left alone, at worst loop() does one scan for nothing
+  _pending[led >> 5] &= ~(1UL << (led & 31));
+}
+
+int LEDEngine::fade_slot(const int led) {
+  for (int i = 0; i < LED_MAX_FADES; i++) {
+    if (_fades[i].led == led) {
+      return i;
+    }
+  }
+  return LED_NONE;
+}
+
+void LEDEngine::set(const int led, const bool on, const unsigned long delay_ms) {
+  if (led == LED_NONE) {
+    return;
+  }
+
+  // this replaces any fade
+  int slot = fade_slot(led);
+  if (slot != LED_NONE) {
+    _fades[slot].led = LED_NONE;
+  }
+
+  if (delay_ms == 0) {
+    unmark(led);
+    write(led, on);
+  } else {
+    _target[led] = on;
+    mark(led, millis() + delay_ms);
+  }
+}
+
+void LEDEngine::fade(const int led, const uint8_t from, const uint8_t to, const unsigned long duration_ms, const bool pulse) {
+  if (led == LED_NONE) {
+    return;
+  }
+
+  int slot = fade_slot(led);
+  if (slot == LED_NONE) {
+    slot = fade_slot(LED_NONE);
+  }
+  if (slot == LED_NONE) {
+    Log.errorln(F("LED: too many fades (max %d)"), LED_MAX_FADES);
+    return;
+  }
+
+  // one step per PWM level
+  Fade &fade = _fades[slot];
+  fade.led = led;
+  fade.from = from;
+  fade.to = to;
+  fade.level = from;
+  fade.pulse = pulse;
+  fade.step_ms = max(duration_ms / max(abs((int)to - (int)from), 1), 1UL);
+
+  analogWrite(_pins[led], from);
+#ifdef LED_PORT_WRITES
+  _pwm[led >> 5] |= (1UL << (led & 31));
+#endif
+  mark(led, millis() + fade.step_ms);
+}
+
+void LEDEngine::step_fade(Fade &fade, const unsigned long now) {
+  fade.level += (fade.to > fade.level) ? 1 : -1;
+  analogWrite(_pins[fade.led], fade.level);
+
+  if (fade.level == fade.to) {
+    if (!fade.pulse) {
+      unmark(fade.led);
+      fade.led = LED_NONE;
+      return;
+    }
+    // turn around
+    fade.to = fade.from;
+    fade.from = fade.level;
+  }
+  _due[fade.led] = now + fade.step_ms;
+}
+
+bool LEDEngine::idle(const int led) {
+  if (led == LED_NONE) {
+    return true;
+  }
+  return (_pending[led >> 5] & (1UL << (led & 31))) == 0;
+}
+
+void LEDEngine::loop() {
+  unsigned long now = millis();
+
+  // nothing due yet (the common case)
+  if ((long)(now - _next_due) < 0) {
+    return;
+  }
+
+#ifdef LED_PORT_WRITES
+  volatile uint8_t *ports[LED_BATCH_PORTS];
+  uint8_t on_masks[LED_BATCH_PORTS];
+  uint8_t off_masks[LED_BATCH_PORTS];
+  uint8_t port_count = 0;
+#endif
+  bool scheduled = false;
+  unsigned long next_due = 0;
+
+  for (int word = 0; word < LED_WORDS(_size); word++) {
+    uint32_t bits = _pending[word];
+    while (bits) {
+      int led = (word << 5) + __builtin_ctzl(bits);
+      bits &= bits - 1;
+
+      if ((long)(now - _due[led]) >= 0) {
+        int slot = fade_slot(led);
+        if (slot != LED_NONE) {
+          step_fade(_fades[slot], now);
+        } else {
+          unmark(led);
+#ifdef LED_PORT_WRITES
+          // collect the change into its port's masks, unless it is coming
+          // out of a fade (write() turns its PWM off first)
+          int port = port_count;
+          if (!(_pwm[led >> 5] & (1UL << (led & 31)))) {
+            for (port = 0; port < port_count && ports[port] != _ports[led]; port++);
+            if (port == port_count && port_count < LED_BATCH_PORTS) {
+              ports[port] = _ports[led];
+              on_masks[port] = 0;
+              off_masks[port] = 0;
+              port_count++;
+            }
+          }
+          if (port < port_count) {
+            if (_target[led]) {
+              on_masks[port] |= _masks[led];
+            } else {
+              off_masks[port] |= _masks[led];
+            }
+          } else {
+            write(led, _target[led]);
+          }
+#else
+          write(led, _target[led]);
+#endif
+        }
+      }
+
+      // track the earliest change still to come
+      if (!idle(led) && (!scheduled || (long)(_due[led] - next_due) < 0)) {
+        next_due = _due[led];
+        scheduled = true;
+      }
+    }
+  }
+
+#ifdef LED_PORT_WRITES
+  for (int port = 0; port < port_count; port++) {
+    uint8_t sreg = SREG;
+    cli();
+    *ports[port] = (*ports[port] | on_masks[port]) & ~off_masks[port];
+    SREG = sreg;
+  }
+#endif
+
+  // with nothing left the next check is as far away as millis() allows
+  _next_due = scheduled ? next_due : now + 0x7FFFFFFFUL;
+}
@@ -0,0 +1,86 @@
+#ifndef _LEDEngine_H
+#define _LEDEngine_H
+
+#include <Arduino.h>
+
+// words of pending bits for a table of n LEDs
+#define LED_WORDS(n) (((n) + 31) / 32)
+// maximum number of LEDs that can be fading/pulsing at once
+#define LED_MAX_FADES 4
+// no LED
+#define LED_NONE -1
+
+// on AVR, LEDs that change together and share a port are written with one
+// port register update
+#if defined(__AVR__)
+#define LED_PORT_WRITES
+#endif
+
+// LEDEngine - drives every LED from one place. Only LEDs with a scheduled
+// change are marked pending, and loop() returns after a single comparison
+// until the earliest of those changes is due.
+class LEDEngine
+{
+private:
+  struct Fade {
+    int16_t led;
+    uint8_t from;
+    uint8_t to;
+    uint8_t level;
+    bool pulse;
+    unsigned long step_ms;
+  };
+
+  // the LED table, sized by reserve()
+  uint8_t *_pins;
+#ifdef LED_PORT_WRITES
+  volatile uint8_t **_ports;
+  uint8_t *_masks;
+  // LEDs last driven by analogWrite(), whose timer has to be disconnected
+  // before a port write shows
+  uint32_t *_pwm;
+#endif
+  int _count;
+  int _size;
+
+  // scheduled changes
+  uint32_t *_pending;
+  uint8_t *_target;
+  unsigned long *_due;
+  unsigned long _next_due;
+  Fade _fades[LED_MAX_FADES];
+
+  void write(const int led, const bool on);
+  void mark(const int led, const unsigned long due);
+  void unmark(const int led);
+  int fade_slot(const int led);
+  void step_fade(Fade &fade, const unsigned long now);
+
+public:
+  LEDEngine();
+
+  // makes room for size LEDs in all (the table only ever grows)
+  void reserve(const int size);
+  int count();
+
+  // registers an LED pin (the same pin always maps to the same LED) - there
+  // has to be room reserved for it
+  int add(const uint8_t pin);
+
+  // on/off now, or after delay_ms (replacing anything already scheduled)
+  void set(const int led, const bool on, const unsigned long delay_ms = 0);
+
+  // fades from one PWM level to another over duration_ms, or (pulse) keeps
+  // fading back and forth between them
+  void fade(const int led, const uint8_t from, const uint8_t to, const unsigned long duration_ms, const bool pulse = false);
+
+  // true if the LED has nothing scheduled
+  bool idle(const int led);
+
+  // eventloop function
+  void loop();
+};
+
+extern LEDEngine LEDs;
+
+#endif
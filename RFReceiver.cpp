@@ -0,0 +1,218 @@
+#include <ArduinoLog.h>
+#include "RFReceiver.h"
+
+// an RCSwitch protocol, pulse lengths in multiples of pulse_us
+struct RFProtocol {
+  uint16_t pulse_us;
+  uint8_t sync_high;
+  uint8_t sync_low;
+  uint8_t zero_high;
+  uint8_t zero_low;
+  uint8_t one_high;
+  uint8_t one_low;
+  bool inverted;
+};
+
+// the same table (and order) as RCSwitch, so existing codes still match
+static const RFProtocol protocols[] PROGMEM = {
+  { 350,   1,  31,   1,   3,   3,   1, false },  // 1
+  { 650,   1,  10,   1,   2,   2,   1, false },  // 2
+  { 100,  30,  71,   4,  11,   9,   6, false },  // 3
+  { 380,   1,   6,   1,   3,   3,   1, false },  // 4
+  { 500,   6,  14,   1,   2,   2,   1, false },  // 5
+  { 450,  23,   1,   1,   2,   2,   1, true },   // 6 (HT6P20B)
+  { 150,   2,  62,   1,   6,   6,   1, false },  // 7 (HS2303-PT)
+  { 200,   3, 130,   7,  16,   3,  16, false },  // 8 (Conrad RS-200 RX)
+  { 200, 130,   7,  16,   7,  16,   3, true },   // 9 (Conrad RS-200 TX)
+  { 365,  18,   1,   3,   1,   1,   3, true },   // 10 (1ByOne doorbell)
+  { 270,  36,   1,   1,   2,   2,   1, true },   // 11 (HT12E)
+  { 320,  36,   1,   1,   2,   2,   1, true },   // 12 (SM5212)
+};
+#define RF_PROTOCOL_COUNT (sizeof(protocols) / sizeof(protocols[0]))
+
+static unsigned long diff(const unsigned long a, const unsigned long b) {
+  return a > b ? a - b : b - a;
+}
+
+// interrupt handlers - attachInterrupt() has no context argument, so each
+// receiver gets a slot with its own trampoline
+static RFReceiver *intr_receivers[RF_MAX_RECEIVERS];
+
+static void intr_receiver_0() { intr_receivers[0]->on_edge(); }
+static void intr_receiver_1() { intr_receivers[1]->on_edge(); }
+
+static void (*intr_handlers[RF_MAX_RECEIVERS])() = { intr_receiver_0, intr_receiver_1 };
+
+// RF Receiver
+RFReceiver::RFReceiver(const unsigned int interrupt) : _interrupt(interrupt)
+{
+  _head = 0;
+  _tail = 0;
+  _overflowed = false;
+  _last_edge_us = 0;
+  _change_count = 0;
+  _repeat_count = 0;
+  _air_us = 0;
+  _resync = false;
+  _code_count = 0;
+  _decoded = 0;
+  _lost = 0;
+  _max_codes = 0;
+}
+
+unsigned int RFReceiver::interrupt() {
+  return _interrupt;
+}
+
+void RFReceiver::begin() {
+  int slot;
+  for (slot = 0; slot < RF_MAX_RECEIVERS && intr_receivers[slot] != nullptr; slot++);
+  if (slot == RF_MAX_RECEIVERS) {
+    Log.errorln(F("RF: no free interrupt slots for interrupt %d"), _interrupt);
+    return;
+  }
+  intr_receivers[slot] = this;
+  _last_edge_us = micros();
+  attachInterrupt(_interrupt, intr_handlers[slot], CHANGE);
+}
+
+void RFReceiver::on_edge() {
+  unsigned long now = micros();
+  unsigned long duration = now - _last_edge_us;
+  _last_edge_us = now;
+
+  uint8_t head = _head;
+  uint8_t next = (head + 1) & RF_BUFFER_MASK;
+  if (next == _tail) {
+    _overflowed = true;
+    return;
+  }
+
+  // after an overflow this duration spans the dropped edges, so it goes in as
+  // the marker instead, and a gap too long for 15 bits goes in coarse
+  uint16_t pulse;
+  if (_overflowed) {
+    pulse = 0;
+  } else if (duration < RF_LONG_FLAG) {
+    pulse = max(duration, 1UL);
+  } else {
+    pulse = RF_LONG_FLAG | (uint16_t)min(duration >> RF_LONG_SHIFT, (unsigned long)(RF_LONG_FLAG - 1));
+  }
+  _pulses[head] = pulse;
+  _overflowed = false;
+  _head = next;
+}
+
+bool RFReceiver::decode_protocol(const int protocol) {
+  RFProtocol pro;
+  memcpy_P(&pro, &protocols[protocol], sizeof(pro));
+
+  // the sync gap in front of the code gives the pulse length it was sent with
+  unsigned long pulse_us = _timings[0] / max(pro.sync_high, pro.sync_low);
+  unsigned long tolerance = pulse_us * RF_TOLERANCE_PERCENT / 100;
+
+  unsigned long code = 0;
+  for (int i = pro.inverted ? 2 : 1; i < _change_count - 1; i += 2) {
+    code <<= 1;
+    if (diff(_timings[i], pulse_us * pro.zero_high) < tolerance && diff(_timings[i + 1], pulse_us * pro.zero_low) < tolerance) {
+      // zero
+    } else if (diff(_timings[i], pulse_us * pro.one_high) < tolerance && diff(_timings[i + 1], pulse_us * pro.one_low) < tolerance) {
+      code |= 1;
+    } else {
+      return false;
+    }
+  }
+
+  // anything this short is noise
+  if (_change_count <= 7) {
+    return false;
+  }
+  _codes[_code_count] = code;
+  _code_times[_code_count] = _air_us;
+  _code_count++;
+  _decoded++;
+  return true;
+}
+
+void RFReceiver::on_pulse(const unsigned long duration) {
+  if (duration == 0) {
+    // edges were dropped, so the code in progress is gone (and how long they
+    // took isn't known, so count them as a long gap)
+    _lost++;
+    _air_us += 0xFFFF;
+    _change_count = 0;
+    _repeat_count = 0;
+    _resync = true;
+    return;
+  }
+  _air_us += duration;
+
+  // the rest of the code the edges were dropped from is discarded, decoding
+  // starts again from the next sync gap
+  if (_resync) {
+    if (duration <= RF_SEPARATION_US) {
+      return;
+    }
+    _resync = false;
+  }
+
+  // a code is only decoded once the sync after it agrees with the one before
+  if (duration > RF_SEPARATION_US) {
+    if (_repeat_count == 0 || diff(duration, _timings[0]) < RF_SEPARATION_TOLERANCE_US) {
+      _repeat_count++;
+      if (_repeat_count == 2) {
+        for (unsigned int i = 0; i < RF_PROTOCOL_COUNT && !decode_protocol(i); i++);
+        _repeat_count = 0;
+      }
+    }
+    _change_count = 0;
+  }
+
+  if (_change_count >= RF_MAX_CHANGES) {
+    _change_count = 0;
+    _repeat_count = 0;
+  }
+  _timings[_change_count++] = min(duration, 0xFFFFUL);
+}
+
+void RFReceiver::decode() {
+  _code_count = 0;
+
+  // everything received up to now, edges arriving meanwhile wait for the next
+  // loop (as do any beyond RF_MAX_CODES codes)
+  uint8_t head = _head;
+  uint8_t tail = _tail;
+  while (tail != head && _code_count < RF_MAX_CODES) {
+    uint16_t pulse = _pulses[tail];
+    on_pulse((pulse & RF_LONG_FLAG) ? ((unsigned long)(pulse & ~RF_LONG_FLAG) << RF_LONG_SHIFT) : pulse);
+    tail = (tail + 1) & RF_BUFFER_MASK;
+    _tail = tail;
+  }
+
+  _max_codes = max(_max_codes, _code_count);
+}
+
+uint8_t RFReceiver::code_count() {
+  return _code_count;
+}
+
+unsigned long RFReceiver::code(const uint8_t i) {
+  return _codes[i];
+}
+
+unsigned long RFReceiver::code_time_us(const uint8_t i) {
+  return _code_times[i];
+}
+
+unsigned long RFReceiver::decoded_count() {
+  return _decoded;
+}
+
+unsigned long RFReceiver::lost_count() {
+  return _lost;
+}
+
+void RFReceiver::log_stats() {
+  Log.traceln(F("RF: interrupt %d decoded=%u lost=%u most in one loop=%d"), _interrupt, _decoded, _lost, _max_codes);
+  _max_codes = 0;
+}
@@ -0,0 +1,97 @@
+#ifndef _RFReceiver_H
+#define _RFReceiver_H
+
+#include <Arduino.h>
+
+// edge times kept between two decodes (a power of two, at most 256)
+#if defined(__AVR__)
+#define RF_BUFFER_SIZE 128
+#else
+#define RF_BUFFER_SIZE 256
+#endif
+#define RF_BUFFER_MASK (RF_BUFFER_SIZE - 1)
+// maximum number of receivers (each needs its own interrupt)
+#define RF_MAX_RECEIVERS 2
+// edges in the longest code (a sync gap, 32 bits and the sync pulse)
+#define RF_MAX_CHANGES 67
+// codes decoded in one loop, any more wait in the buffer for the next
+#define RF_MAX_CODES 8
+// how far a pulse can be from its expected length (percent)
+#define RF_TOLERANCE_PERCENT 60
+// a gap longer than this is the sync either side of a code
+#define RF_SEPARATION_US 4300
+// how closely the sync gaps either side of a code have to agree
+#define RF_SEPARATION_TOLERANCE_US 200
+// edge times over 15 bits go in the buffer in units of 1 << RF_LONG_SHIFT us
+// (so up to 2.1s, well past any lockout between codes) with the top bit set
+#define RF_LONG_FLAG 0x8000
+#define RF_LONG_SHIFT 6
+
+// RFReceiver - a 433MHz receiver, decoding the RCSwitch protocols. The
+// interrupt only records the time since the last edge into a ring buffer and
+// the codes are decoded from it in the main loop, so every code received since
+// the last loop is kept (not just the latest) and the interrupt is short.
+class RFReceiver
+{
+private:
+  const unsigned int _interrupt;
+
+  // written by the interrupt (0 marks where edges were dropped as it was full,
+  // and RF_LONG_FLAG a coarse long gap)
+  volatile uint16_t _pulses[RF_BUFFER_SIZE];
+  volatile uint8_t _head;
+  volatile bool _overflowed;
+  volatile unsigned long _last_edge_us;
+  // read up to here by decode()
+  volatile uint8_t _tail;
+
+  // the code being received, and the time on air (the sum of every pulse
+  // decoded, so it is not thrown by how late the decode runs)
+  uint16_t _timings[RF_MAX_CHANGES];
+  uint8_t _change_count;
+  uint8_t _repeat_count;
+  unsigned long _air_us;
+  // set by a dropped edges marker, until the next sync gap
+  bool _resync;
+
+  // the codes decoded this loop, and when each finished on air
+  unsigned long _codes[RF_MAX_CODES];
+  unsigned long _code_times[RF_MAX_CODES];
+  uint8_t _code_count;
+
+  // stats
+  unsigned long _decoded;
+  unsigned long _lost;
+  uint8_t _max_codes;
+
+  void on_pulse(const unsigned long duration);
+  bool decode_protocol(const int protocol);
+
+public:
+  RFReceiver(const unsigned int interrupt);
+
+  // accessors
+  unsigned int interrupt();
+
+  // the codes decoded this loop, in the order they were received, and when
+  // each finished on air (on the receiver's own timeline, so only for
+  // comparing with other codes from it)
+  uint8_t code_count();
+  unsigned long code(const uint8_t i);
+  unsigned long code_time_us(const uint8_t i);
+
+  // stats
+  unsigned long decoded_count();
+  unsigned long lost_count();
+
+  // interrupt handler
+  void on_edge();
+
+  // eventloop functions
+  void begin();
+  void decode();
+
+  void log_stats();
+};
+
+#endif
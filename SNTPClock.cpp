@@ -0,0 +1,250 @@
+#include <ArduinoLog.h>
+#include "SNTPClock.h"
+
+#define SNTP_ORIGINATE_OFFSET 24
+#define SNTP_RECEIVE_OFFSET 32
+#define SNTP_TRANSMIT_OFFSET 40
+
+static uint64_t read_timestamp(const uint8_t *data) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+static void write_timestamp(uint8_t *data, uint64_t value) {
+  for (int i = 7; i >= 0; i--) {
+    data[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+// NTP format to microseconds (only for values under a couple of minutes)
+static long to_us(const int64_t value) {
+  return value * 15625 / 67108864;
+}
+
+// SNTP Clock
+SNTPClock::SNTPClock(UDP *udp, ArmedSocket *socket, const IPAddress &server, const uint16_t port, const unsigned long poll_ms) : _udp(udp), _socket(socket), _server(server), _port(port), _poll_ms(poll_ms)
+{
+  _base_time = 0;
+  _base_us = micros();
+  _drift_ppb = 0;
+  _synced = false;
+  _last_sample_us = 0;
+  // LI 0, version 4, mode 3 (client), only the transmit timestamp changes
+  memset(_packet, 0, sizeof(_packet));
+  _packet[0] = 0x23;
+  _waiting = false;
+  _request_time = 0;
+  _request_ms = 0;
+  _retry_ms = SNTP_RETRY_MS;
+  _send_errors = 0;
+  _offset_us = 0;
+  _delay_us = 0;
+  _offset_min_us = 0;
+  _offset_max_us = 0;
+  _samples = 0;
+  _rejected = 0;
+  _timeouts = 0;
+}
+
+bool SNTPClock::begin() {
+  if (_socket) {
+    if (!_socket->open(SNTP_LOCAL_PORT, _server, _port) || !_socket->arm(_packet, SNTP_PACKET_SIZE)) {
+      Log.errorln(F("SNTP: unable to open UDP socket"));
+      return false;
+    }
+  } else if (!_udp->begin(SNTP_LOCAL_PORT)) {
+    Log.errorln(F("SNTP: unable to open UDP socket"));
+    return false;
+  }
+  request();
+  return true;
+}
+
+uint64_t SNTPClock::from_us(const unsigned long us) {
+  return ((uint64_t)(us / 1000000) << 32) + (((uint64_t)(us % 1000000) << 32) / 1000000);
+}
+
+uint64_t SNTPClock::from_ms(const unsigned long ms) {
+  return ((uint64_t)(ms / 1000) << 32) + (((uint64_t)(ms % 1000) << 32) / 1000);
+}
+
+uint64_t SNTPClock::at(const unsigned long us) {
+  unsigned long elapsed = us - _base_us;
+  int64_t corrected = (int64_t)elapsed + (int64_t)elapsed * _drift_ppb / 1000000000LL;
+  return _base_time + from_us((unsigned long)corrected);
+}
+
+uint64_t SNTPClock::now() {
+  return at(micros());
+}
+
+bool SNTPClock::synced() {
+  return _synced;
+}
+
+void SNTPClock::request() {
+  _request_ms = millis();
+
+  // the transmit timestamp goes in last, so it is as close to the send as it
+  // can be (the server echoes it back, so the reply can be matched to it)
+  if (_socket) {
+    // firing while the last send is still going would wait for it
+    if (_socket->in_flight()) {
+      return;
+    }
+    _request_time = now();
+    write_timestamp(_packet + SNTP_TRANSMIT_OFFSET, _request_time);
+    _socket->patch(SNTP_TRANSMIT_OFFSET, _packet + SNTP_TRANSMIT_OFFSET, SNTP_PACKET_SIZE - SNTP_TRANSMIT_OFFSET);
+    _send_errors = _socket->errors();
+    if (!_socket->fire()) {
+      return;
+    }
+  } else {
+    _udp->beginPacket(_server, _port);
+    _udp->write(_packet, SNTP_TRANSMIT_OFFSET);
+    _request_time = now();
+    write_timestamp(_packet + SNTP_TRANSMIT_OFFSET, _request_time);
+    _udp->write(_packet + SNTP_TRANSMIT_OFFSET, SNTP_PACKET_SIZE - SNTP_TRANSMIT_OFFSET);
+    if (!_udp->endPacket()) {
+      Log.errorln(F("SNTP: unable to send request"));
+    }
+  }
+
+  _waiting = true;
+}
+
+void SNTPClock::receive() {
+  int size = _udp->parsePacket();
+  if (size <= 0) {
+    return;
+  }
+  unsigned long reply_us = micros();
+  uint64_t reply_time = at(reply_us);
+
+  // anything else is skipped by the next parsePacket()
+  uint8_t packet[SNTP_PACKET_SIZE];
+  if (size < SNTP_PACKET_SIZE || _udp->read(packet, SNTP_PACKET_SIZE) != SNTP_PACKET_SIZE) {
+    return;
+  }
+
+  // only a server reply to the request in flight (stratum 0 is a refusal)
+  uint8_t mode = packet[0] & 0x07;
+  uint8_t stratum = packet[1];
+  if (mode != 4 || read_timestamp(packet + SNTP_ORIGINATE_OFFSET) != _request_time) {
+    return;
+  }
+  _waiting = false;
+  _retry_ms = SNTP_RETRY_MS;
+  if (stratum == 0 || stratum > 15) {
+    Log.errorln(F("SNTP: server refused the request (stratum %d)"), stratum);
+    _rejected++;
+    return;
+  }
+
+  sample(_request_time, read_timestamp(packet + SNTP_RECEIVE_OFFSET), read_timestamp(packet + SNTP_TRANSMIT_OFFSET), reply_time, reply_us);
+}
+
+void SNTPClock::sample(const uint64_t request_time, const uint64_t server_receive, const uint64_t server_transmit, const uint64_t reply_time, const unsigned long reply_us) {
+  // round trip, less the time the server held on to the request
+  int64_t delay = (int64_t)(reply_time - request_time) - (int64_t)(server_transmit - server_receive);
+  if (delay < 0 || delay > (int64_t)from_us(SNTP_MAX_DELAY_US)) {
+    _rejected++;
+    return;
+  }
+  _delay_us = to_us(delay);
+  _samples++;
+
+  // the first reply sets the clock
+  if (!_synced) {
+    _base_time = server_transmit + delay / 2;
+    _base_us = reply_us;
+    _last_sample_us = reply_us;
+    _synced = true;
+    Log.traceln(F("SNTP: clock set (delay %uus)"), _delay_us);
+    return;
+  }
+
+  // how far the server is ahead of us
+  int64_t offset = ((int64_t)(server_receive - request_time) + (int64_t)(server_transmit - reply_time)) / 2;
+  uint64_t now = at(reply_us);
+  _base_us = reply_us;
+  if (offset > (int64_t)from_us(SNTP_STEP_US) || offset < -(int64_t)from_us(SNTP_STEP_US)) {
+    // too far out to trust the drift estimate
+    _base_time = now + offset;
+    _drift_ppb = 0;
+    _last_sample_us = reply_us;
+    Log.errorln(F("SNTP: clock stepped"));
+    return;
+  }
+  _base_time = now + offset;
+
+  // what is left after the last correction is down to the drift estimate
+  _offset_us = to_us(offset);
+  unsigned long interval_us = reply_us - _last_sample_us;
+  if (interval_us >= 1000000) {
+    int64_t error_ppb = (int64_t)_offset_us * 1000000000LL / (int64_t)interval_us;
+    _drift_ppb = constrain(_drift_ppb + error_ppb / 2, -SNTP_MAX_DRIFT_PPB, SNTP_MAX_DRIFT_PPB);
+  }
+  _last_sample_us = reply_us;
+
+  _offset_min_us = min(_offset_min_us, _offset_us);
+  _offset_max_us = max(_offset_max_us, _offset_us);
+}
+
+long SNTPClock::offset_us() {
+  return _offset_us;
+}
+
+unsigned long SNTPClock::delay_us() {
+  return _delay_us;
+}
+
+int32_t SNTPClock::drift_ppb() {
+  return _drift_ppb;
+}
+
+unsigned long SNTPClock::samples() {
+  return _samples;
+}
+
+void SNTPClock::loop() {
+  // keep the base recent, so micros() wrapping never matters
+  unsigned long us = micros();
+  if ((us - _base_us) > 0x40000000UL) {
+    _base_time = at(us);
+    _base_us = us;
+  }
+
+  // picks up how the last send went, and stages the request again
+  if (_socket) {
+    _socket->loop();
+  }
+
+  if (_waiting) {
+    receive();
+    // the chip gives up on a send the server never answered ARP for
+    bool failed = _socket && !_socket->in_flight() && _socket->errors() != _send_errors;
+    if (_waiting && (failed || (millis() - _request_ms) >= SNTP_TIMEOUT_MS)) {
+      _waiting = false;
+      _timeouts++;
+      _retry_ms = min(_retry_ms * 2, (unsigned long)SNTP_RETRY_MAX_MS);
+    }
+    return;
+  }
+
+  // after a timeout, wait longer each time until the server answers again
+  if ((millis() - _request_ms) >= (_synced ? max(_poll_ms, _retry_ms) : _retry_ms)) {
+    request();
+  }
+}
+
+void SNTPClock::log_stats() {
+  Log.traceln(F("SNTP: synced=%d offset=%lus (min=%l max=%l) delay=%uus drift=%lppb samples=%u rejected=%u timeouts=%u"),
+              _synced, _offset_us, _offset_min_us, _offset_max_us, _delay_us, (long)_drift_ppb, _samples, _rejected, _timeouts);
+  _offset_min_us = _offset_us;
+  _offset_max_us = _offset_us;
+}
@@ -0,0 +1,102 @@
+#ifndef _SNTPClock_H
+#define _SNTPClock_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Udp.h>
+#include "TargetSocket.h"
+
+// default SNTP server port
+#define SNTP_PORT 123
+// local port the requests are sent from
+#define SNTP_LOCAL_PORT 50123
+// how long to wait for a reply, and to wait before retrying until synced
+#define SNTP_TIMEOUT_MS 1000
+#define SNTP_RETRY_MS 2000
+// each timeout doubles the wait before the next request, up to this
+#define SNTP_RETRY_MAX_MS 64000
+// replies that took longer than this for the round trip are not trusted
+#define SNTP_MAX_DELAY_US 100000
+// offsets larger than this step the clock and restart the drift estimate
+#define SNTP_STEP_US 128000
+// limit on the drift correction (parts per billion)
+#define SNTP_MAX_DRIFT_PPB 500000
+// the OSC/NTP timetag for "immediately"
+#define NTP_IMMEDIATE 1ULL
+#define SNTP_PACKET_SIZE 48
+
+// SNTPClock - a wall clock (in 32.32 NTP format) kept in step with an SNTP
+// server. Requests are sent every poll_ms and the reply is picked up from
+// loop(), so nothing blocks; each reply corrects the offset and refines an
+// estimate of how fast micros() runs against the server. On the W5x00 the
+// request is kept staged in an ArmedSocket and sent with a bare SEND, so a
+// server that doesn't answer ARP shows up as a timeout in loop() rather than
+// a 1.8s wait in endPacket().
+class SNTPClock
+{
+private:
+  UDP *_udp;
+  ArmedSocket *_socket;
+  IPAddress _server;
+  uint16_t _port;
+  unsigned long _poll_ms;
+
+  // the clock is _base_time at micros() == _base_us, corrected by _drift_ppb
+  uint64_t _base_time;
+  unsigned long _base_us;
+  int32_t _drift_ppb;
+  bool _synced;
+  unsigned long _last_sample_us;
+
+  // the request in flight
+  uint8_t _packet[SNTP_PACKET_SIZE];
+  bool _waiting;
+  uint64_t _request_time;
+  unsigned long _request_ms;
+  unsigned long _retry_ms;
+  unsigned long _send_errors;
+
+  // stats
+  long _offset_us;
+  unsigned long _delay_us;
+  long _offset_min_us;
+  long _offset_max_us;
+  unsigned long _samples;
+  unsigned long _rejected;
+  unsigned long _timeouts;
+
+  uint64_t at(const unsigned long us);
+  void request();
+  void receive();
+  void sample(const uint64_t request_time, const uint64_t server_receive, const uint64_t server_transmit, const uint64_t reply_time, const unsigned long reply_us);
+
+public:
+  // socket is udp when it is the W5x00's (NULL otherwise)
+  SNTPClock(UDP *udp, ArmedSocket *socket, const IPAddress &server, const uint16_t port, const unsigned long poll_ms);
+
+  // opens the socket and sends the first request
+  bool begin();
+
+  // true once the first reply has set the clock
+  bool synced();
+
+  // the current time (NTP format, seconds since 1900 in the top 32 bits)
+  uint64_t now();
+
+  // NTP format durations
+  static uint64_t from_us(const unsigned long us);
+  static uint64_t from_ms(const unsigned long ms);
+
+  // stats
+  long offset_us();
+  unsigned long delay_us();
+  int32_t drift_ppb();
+  unsigned long samples();
+
+  // eventloop function
+  void loop();
+
+  void log_stats();
+};
+
+#endif
@@ -0,0 +1,453 @@
+#include <ArduinoLog.h>
+#include <utility/w5100.h>
+#include "TargetSocket.h"
+
+// Target Socket
+TargetSocket::TargetSocket() : EthernetUDP()
+{
+  _port = 0;
+  _packets = 0;
+  _bytes = 0;
+  _errors = 0;
+}
+
+bool TargetSocket::open(const uint16_t local_port, const IPAddress &ip, const uint16_t port) {
+  // let the Ethernet library allocate (and own) the hardware socket
+  if (!begin(local_port)) {
+    return false;
+  }
+
+  _ip = ip;
+  _port = port;
+
+  // fix the destination, the chip keeps it across sends
+  uint8_t address[4] = { ip[0], ip[1], ip[2], ip[3] };
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  W5100.writeSnDIPR(sockindex, address);
+  W5100.writeSnDPORT(sockindex, port);
+  SPI.endTransaction();
+
+  return true;
+}
+
+void TargetSocket::write_tx(const uint16_t ptr, const uint8_t *data, const uint16_t length) {
+  uint16_t offset = ptr & W5100.SMASK;
+  uint16_t address = offset + W5100.SBASE(sockindex);
+  if (W5100.hasOffsetAddressMapping() || offset + length <= W5100.SSIZE) {
+    W5100.write(address, data, length);
+  } else {
+    // wrap around the circular buffer
+    uint16_t size = W5100.SSIZE - offset;
+    W5100.write(address, data, size);
+    W5100.write(W5100.SBASE(sockindex), data + size, length - size);
+  }
+}
+
+uint16_t TargetSocket::stage(const uint8_t *data, const uint16_t length) {
+  // the previous send has completed, so the TX buffer is empty and the whole
+  // packet goes in with one write
+  uint16_t ptr = W5100.readSnTX_WR(sockindex);
+  write_tx(ptr, data, length);
+  W5100.writeSnTX_WR(sockindex, ptr + length);
+  return ptr;
+}
+
+bool TargetSocket::complete() {
+  while ((W5100.readSnIR(sockindex) & SnIR::SEND_OK) != SnIR::SEND_OK) {
+    if (W5100.readSnIR(sockindex) & SnIR::TIMEOUT) {
+      W5100.writeSnIR(sockindex, (SnIR::SEND_OK | SnIR::TIMEOUT));
+      return false;
+    }
+  }
+  W5100.writeSnIR(sockindex, SnIR::SEND_OK);
+  return true;
+}
+
+bool TargetSocket::send(const uint8_t *data, const uint16_t length) {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  stage(data, length);
+  W5100.execCmdSn(sockindex, Sock_SEND);
+  bool sent = complete();
+  SPI.endTransaction();
+
+  if (sent) {
+    _packets++;
+    _bytes += length;
+  } else {
+    _errors++;
+  }
+  return sent;
+}
+
+uint8_t TargetSocket::socket() {
+  return sockindex;
+}
+
+IPAddress TargetSocket::ip() {
+  return _ip;
+}
+
+uint16_t TargetSocket::port() {
+  return _port;
+}
+
+unsigned long TargetSocket::packets() {
+  return _packets;
+}
+
+unsigned long TargetSocket::bytes() {
+  return _bytes;
+}
+
+unsigned long TargetSocket::errors() {
+  return _errors;
+}
+
+// Armed Socket
+ArmedSocket::ArmedSocket() : TargetSocket()
+{
+  _data = NULL;
+  _length = 0;
+  _staged_ptr = 0;
+  _armed = false;
+  _in_flight = false;
+}
+
+bool ArmedSocket::arm(const uint8_t *data, const uint16_t length) {
+  _data = data;
+  _length = length;
+
+  // only stage into a socket that is still open (the chip may have been
+  // reset under it), so fire() never issues a SEND that can't go
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  _armed = (W5100.readSnSR(sockindex) == SnSR::UDP);
+  if (_armed) {
+    _staged_ptr = stage(_data, _length);
+  }
+  SPI.endTransaction();
+  return _armed;
+}
+
+void ArmedSocket::finish(const bool sent) {
+  _in_flight = false;
+  if (sent) {
+    _packets++;
+    _bytes += _length;
+  } else {
+    _errors++;
+  }
+}
+
+bool ArmedSocket::ready() {
+  if (!_armed) {
+    // pressed again before the last send was re-armed, so finish that now
+    if (_in_flight) {
+      SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+      bool sent = complete();
+      SPI.endTransaction();
+      finish(sent);
+    }
+    return arm(_data, _length);
+  }
+  return true;
+}
+
+void ArmedSocket::patch(const uint16_t offset, const uint8_t *data, const uint16_t length) {
+  if (!ready()) {
+    return;
+  }
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  write_tx(_staged_ptr + offset, data, length);
+  SPI.endTransaction();
+}
+
+bool ArmedSocket::fire() {
+  if (!ready()) {
+    // nothing staged to send, the caller has to send it another way
+    Log.errorln(F("SOCKET: %d is no longer open, unable to fire"), sockindex);
+    _errors++;
+    return false;
+  }
+
+  // the packet is already in the chip, all that is left is the command
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  W5100.execCmdSn(sockindex, Sock_SEND);
+  SPI.endTransaction();
+  _armed = false;
+  _in_flight = true;
+  return true;
+}
+
+bool ArmedSocket::in_flight() {
+  return _in_flight;
+}
+
+void ArmedSocket::loop() {
+  if (!_in_flight) {
+    return;
+  }
+
+  // once the send has completed, stage the packet again for the next press
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  uint8_t ir = W5100.readSnIR(sockindex);
+  SPI.endTransaction();
+  if (ir & (SnIR::SEND_OK | SnIR::TIMEOUT)) {
+    SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+    W5100.writeSnIR(sockindex, (SnIR::SEND_OK | SnIR::TIMEOUT));
+    SPI.endTransaction();
+    finish(ir & SnIR::SEND_OK);
+    // if this fails, the next fire() tries again (and tells the caller)
+    arm(_data, _length);
+  }
+}
+
+// TCP Socket
+TCPSocket::TCPSocket() : TargetSocket()
+{
+  _sending = false;
+  _local_port = 0;
+}
+
+bool TCPSocket::reopen(const uint16_t local_port) {
+  // from scratch, so this also drops any connection (and anything left in the
+  // TX buffer) - the socket is only closed within this call, so nothing else
+  // can be given it
+  W5100.execCmdSn(sockindex, Sock_CLOSE);
+  W5100.writeSnIR(sockindex, 0xFF);
+  W5100.writeSnMR(sockindex, SnMR::TCP);
+  W5100.writeSnPORT(sockindex, local_port);
+  W5100.execCmdSn(sockindex, Sock_OPEN);
+  _local_port = local_port;
+  _sending = false;
+  return (W5100.readSnSR(sockindex) == SnSR::INIT);
+}
+
+bool TCPSocket::connect(const uint16_t local_port) {
+  IPAddress ip = this->ip();
+  uint8_t address[4] = { ip[0], ip[1], ip[2], ip[3] };
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  bool opened = reopen(local_port);
+  if (opened) {
+    W5100.writeSnDIPR(sockindex, address);
+    W5100.writeSnDPORT(sockindex, port());
+    W5100.execCmdSn(sockindex, Sock_CONNECT);
+  }
+  SPI.endTransaction();
+
+  return opened;
+}
+
+void TCPSocket::disconnect() {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  bool opened = reopen(_local_port);
+  SPI.endTransaction();
+
+  if (!opened) {
+    Log.errorln(F("SOCKET: %d didn't reopen after disconnecting"), sockindex);
+  }
+}
+
+TCPState TCPSocket::state() {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  uint8_t status = W5100.readSnSR(sockindex);
+  bool opened = true;
+  if (status == SnSR::CLOSED) {
+    // reset or timed out, take it back before the library can give it away
+    opened = reopen(_local_port);
+  }
+  SPI.endTransaction();
+
+  if (!opened) {
+    Log.errorln(F("SOCKET: %d didn't reopen after closing"), sockindex);
+  }
+
+  switch (status) {
+    case SnSR::ESTABLISHED:
+      return TCP_CONNECTED;
+    case SnSR::INIT:
+    case SnSR::SYNSENT:
+      return TCP_CONNECTING;
+    default:
+      // closed, or closing (including by the other end)
+      return TCP_CLOSED;
+  }
+}
+
+void TCPSocket::loop() {
+  // only to keep the socket from reading closed between stream polls
+  state();
+}
+
+uint16_t TCPSocket::writable() {
+  uint16_t free = 0;
+
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  if (_sending) {
+    uint8_t ir = W5100.readSnIR(sockindex);
+    if (ir & (SnIR::SEND_OK | SnIR::TIMEOUT)) {
+      W5100.writeSnIR(sockindex, (SnIR::SEND_OK | SnIR::TIMEOUT));
+      _sending = false;
+      if (ir & SnIR::TIMEOUT) {
+        _errors++;
+      }
+    }
+  }
+  if (!_sending) {
+    free = free_size();
+  }
+  SPI.endTransaction();
+
+  return free;
+}
+
+uint16_t TCPSocket::unacked() {
+  // in TCP mode the chip only frees TX buffer space once it has been ACKed
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  uint16_t free = free_size();
+  SPI.endTransaction();
+  return W5100.SSIZE - free;
+}
+
+uint16_t TCPSocket::free_size() {
+  // the free size can change between its two bytes being read, so read it
+  // until it holds still
+  uint16_t previous;
+  uint16_t free = W5100.readSnTX_FSR(sockindex);
+  do {
+    previous = free;
+    free = W5100.readSnTX_FSR(sockindex);
+  } while (free != previous);
+  return free;
+}
+
+void TCPSocket::queue(const uint8_t *data, const uint16_t length) {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  stage(data, length);
+  SPI.endTransaction();
+  _bytes += length;
+}
+
+void TCPSocket::transmit() {
+  SPI.beginTransaction(SPI_ETHERNET_SETTINGS);
+  W5100.execCmdSn(sockindex, Sock_SEND);
+  SPI.endTransaction();
+  _sending = true;
+  _packets++;
+}
+
+// Socket Pool
+SocketPool::SocketPool(const int in_use)
+{
+  // the W5100 has 4 sockets, the W5200/W5500 have 8
+  int sockets = (Ethernet.hardwareStatus() == EthernetW5100) ? 4 : 8;
+  sockets = min(sockets, MAX_SOCK_NUM);
+
+  _capacity = max(sockets - in_use - SOCKET_POOL_RESERVED, 0);
+  _count = 0;
+  _next_port = SOCKET_POOL_BASE_PORT;
+  _sockets = (TargetSocket**)malloc(sizeof(TargetSocket*) * max(_capacity, 1));
+
+  Log.traceln(F("SOCKET: %d of %d hardware sockets available to the pool"), _capacity, sockets);
+}
+
+bool SocketPool::add(TargetSocket *socket, const IPAddress &ip, const uint16_t port) {
+  // the library takes the first closed socket, so don't let it be a TCP one
+  loop();
+
+  // local ports aren't reused, so a closed socket's late replies can't land on
+  // its replacement
+  if (!socket->open(next_port(), ip, port)) {
+    Log.errorln(F("SOCKET: unable to open a socket"));
+    // the library ran out before we did, don't try again
+    _capacity = _count;
+    return false;
+  }
+
+  _sockets[_count++] = socket;
+  return true;
+}
+
+TargetSocket *SocketPool::open(const IPAddress &ip, const uint16_t port) {
+  if (_count >= _capacity) {
+    return NULL;
+  }
+
+  TargetSocket *socket = new TargetSocket();
+  if (!add(socket, ip, port)) {
+    delete socket;
+    return NULL;
+  }
+  return socket;
+}
+
+ArmedSocket *SocketPool::open_armed(const IPAddress &ip, const uint16_t port, const uint8_t *data, const uint16_t length) {
+  if (_count >= _capacity) {
+    return NULL;
+  }
+
+  ArmedSocket *socket = new ArmedSocket();
+  if (!add(socket, ip, port)) {
+    delete socket;
+    return NULL;
+  }
+  socket->arm(data, length);
+  return socket;
+}
+
+TCPSocket *SocketPool::open_tcp(const IPAddress &ip, const uint16_t port) {
+  if (_count >= _capacity) {
+    return NULL;
+  }
+
+  TCPSocket *socket = new TCPSocket();
+  if (!add(socket, ip, port)) {
+    delete socket;
+    return NULL;
+  }
+  return socket;
+}
+
+void SocketPool::close(TargetSocket *socket) {
+  for (int i = 0; i < _count; i++) {
+    if (_sockets[i] == socket) {
+      // keep the open sockets together at the front
+      _sockets[i] = _sockets[--_count];
+      break;
+    }
+  }
+
+  socket->stop();
+  delete socket;
+}
+
+int SocketPool::count() {
+  return _count;
+}
+
+TargetSocket *SocketPool::socket(const int index) {
+  return _sockets[index];
+}
+
+uint16_t SocketPool::next_port() {
+  // wrap back to the base rather than into the well known ports
+  uint16_t port = _next_port;
+  _next_port = (_next_port == 65535) ? SOCKET_POOL_BASE_PORT : _next_port + 1;
+  return port;
+}
+
+void SocketPool::loop() {
+  for (int i = 0; i < _count; i++) {
+    _sockets[i]->loop();
+  }
+}
+
+void SocketPool::log_stats() {
+  for (int i = 0; i < _count; i++) {
+    TargetSocket *socket = _sockets[i];
+    Log.trace(F("SOCKET: %d -> "), socket->socket());
+    Log.trace(socket->ip());
+    Log.traceln(F(":%u packets=%u bytes=%u errors=%u"), (unsigned long)socket->port(), socket->packets(), socket->bytes(), socket->errors());
+  }
+}
@@ -0,0 +1,176 @@
+#ifndef _TargetSocket_H
+#define _TargetSocket_H
+
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+// first local port used for dedicated target sockets
+#define SOCKET_POOL_BASE_PORT 54001
+// sockets kept back for DHCP renewal/DNS
+#define SOCKET_POOL_RESERVED 1
+
+// TargetSocket - a W5x00 hardware UDP socket dedicated to one destination.
+// The destination registers are written once when the socket is opened, and
+// each send is a single TX buffer write followed by the SEND command.
+class TargetSocket : public EthernetUDP
+{
+private:
+  IPAddress _ip;
+  uint16_t _port;
+
+protected:
+  unsigned long _packets;
+  unsigned long _bytes;
+  unsigned long _errors;
+
+  // copy data into the chip's TX buffer at ptr (wrapping around as needed)
+  void write_tx(const uint16_t ptr, const uint8_t *data, const uint16_t length);
+  // copy a packet into the chip's TX buffer, ready for a SEND command
+  // (returns where it starts)
+  uint16_t stage(const uint8_t *data, const uint16_t length);
+  // wait for the SEND command to complete (true if it was sent)
+  bool complete();
+
+public:
+  TargetSocket();
+  virtual ~TargetSocket() {}
+
+  // opens the socket on local_port with the destination fixed to ip:port
+  bool open(const uint16_t local_port, const IPAddress &ip, const uint16_t port);
+
+  // sends a complete packet to the destination
+  bool send(const uint8_t *data, const uint16_t length);
+
+  // accessors
+  uint8_t socket();
+  IPAddress ip();
+  uint16_t port();
+
+  // counters
+  unsigned long packets();
+  unsigned long bytes();
+  unsigned long errors();
+
+  // eventloop function (for sockets with background work)
+  virtual void loop() {}
+};
+
+// ArmedSocket - a TargetSocket that keeps one packet staged in the chip, so
+// firing it is just the SEND command; the packet is re-staged from loop()
+// once the send has completed
+class ArmedSocket : public TargetSocket
+{
+private:
+  const uint8_t *_data;
+  uint16_t _length;
+  uint16_t _staged_ptr;
+  bool _armed;
+  bool _in_flight;
+
+  void finish(const bool sent);
+  // stages the packet if it isn't already (false if it can't be)
+  bool ready();
+
+public:
+  ArmedSocket();
+
+  // stages data (which must stay valid) to be sent by fire() (false if the
+  // socket is no longer open)
+  bool arm(const uint8_t *data, const uint16_t length);
+
+  // rewrites part of the staged packet (and so of data) before it is fired
+  void patch(const uint16_t offset, const uint8_t *data, const uint16_t length);
+
+  // sends the staged packet without waiting for it to go out (false if there
+  // was nothing staged to send)
+  bool fire();
+  // true from fire() until the chip reports the send done (or timed out)
+  bool in_flight();
+
+  void loop();
+};
+
+// TCP connection states (as much as a stream needs to know)
+typedef enum tcp_state {
+  TCP_CLOSED,
+  TCP_CONNECTING,
+  TCP_CONNECTED
+} TCPState;
+
+// TCPSocket - a pool socket reopened in TCP mode. Connecting and sending only
+// issue the command, and how they went is read back from the socket
+// registers later, so nothing here waits on the network. The Ethernet library
+// hands out any socket it finds closed, and the chip closes this one itself
+// on a reset or a connect timeout, so it is reopened (unconnected) as soon as
+// that is seen: by state(), and on every pool loop ahead of anything that
+// could open another socket.
+class TCPSocket : public TargetSocket
+{
+private:
+  bool _sending;
+  uint16_t _local_port;
+
+  bool reopen(const uint16_t local_port);
+  uint16_t free_size();
+
+public:
+  TCPSocket();
+
+  // (re)opens the socket in TCP mode from local_port and starts connecting
+  // to the destination (false if the socket didn't open)
+  bool connect(const uint16_t local_port);
+  // drops the connection, keeping the socket
+  void disconnect();
+  // (reopens the socket if the chip has closed it)
+  TCPState state();
+
+  // bytes that can be queued now (0 until the last transmit has completed)
+  uint16_t writable();
+  // bytes transmitted that the other end hasn't acknowledged yet
+  uint16_t unacked();
+  // copies data into the TX buffer after anything already queued
+  void queue(const uint8_t *data, const uint16_t length);
+  // sends everything queued (as few segments as the chip can)
+  void transmit();
+
+  void loop();
+};
+
+// SocketPool - hands out the W5x00's hardware sockets to targets and armed
+// buttons until only the reserved sockets are left
+class SocketPool
+{
+private:
+  TargetSocket **_sockets;
+  int _count;
+  int _capacity;
+  uint16_t _next_port;
+
+  bool add(TargetSocket *socket, const IPAddress &ip, const uint16_t port);
+
+public:
+  SocketPool(const int in_use);
+
+  // a socket dedicated to ip:port, or NULL if the pool is exhausted
+  TargetSocket *open(const IPAddress &ip, const uint16_t port);
+  // a socket with data kept staged for ip:port, or NULL if the pool is exhausted
+  ArmedSocket *open_armed(const IPAddress &ip, const uint16_t port, const uint8_t *data, const uint16_t length);
+  // a socket to be reopened in TCP mode for ip:port, or NULL if the pool is exhausted
+  TCPSocket *open_tcp(const IPAddress &ip, const uint16_t port);
+  // gives a socket back to the pool (and deletes it)
+  void close(TargetSocket *socket);
+
+  // accessors
+  int count();
+  TargetSocket *socket(const int index);
+  // the next local port (counting up from SOCKET_POOL_BASE_PORT, and wrapping
+  // back to it)
+  uint16_t next_port();
+
+  // eventloop function
+  void loop();
+
+  void log_stats();
+};
+
+#endif
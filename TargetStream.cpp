@@ -0,0 +1,245 @@
+#include <ArduinoLog.h>
+#include "TargetStream.h"
+
+// Target Stream
+TargetStream::TargetStream(const IPAddress &ip, const uint16_t port) : _ip(ip), _port(port)
+{
+  _tail = 0;
+  _count = 0;
+  _sent = 0;
+  _state = TCP_CLOSED;
+  _retry_ms = 0;
+  _state_ms = millis();
+  _last_poll = 0;
+  _messages = 0;
+  _dropped = 0;
+  _writes = 0;
+  _connects = 0;
+  _disconnects = 0;
+  _queued_max = 0;
+}
+
+IPAddress TargetStream::ip() {
+  return _ip;
+}
+
+uint16_t TargetStream::port() {
+  return _port;
+}
+
+bool TargetStream::connected() {
+  return _state == TCP_CONNECTED;
+}
+
+unsigned long TargetStream::messages() {
+  return _messages;
+}
+
+unsigned long TargetStream::dropped() {
+  return _dropped;
+}
+
+unsigned long TargetStream::connects() {
+  return _connects;
+}
+
+void TargetStream::enqueue(const uint8_t c) {
+  _queue[(_tail + _count) % STREAM_QUEUE_SIZE] = c;
+  _count++;
+}
+
+bool TargetStream::send(const uint8_t *data, const uint16_t length) {
+  // work out the framed size first, so only whole messages are queued
+  uint16_t framed = 2;
+  for (uint16_t i = 0; i < length; i++) {
+    framed += (data[i] == SLIP_END || data[i] == SLIP_ESC) ? 2 : 1;
+  }
+  if (framed > STREAM_QUEUE_SIZE - _count) {
+    _dropped++;
+    return false;
+  }
+
+  enqueue(SLIP_END);
+  for (uint16_t i = 0; i < length; i++) {
+    if (data[i] == SLIP_END) {
+      enqueue(SLIP_ESC);
+      enqueue(SLIP_ESC_END);
+    } else if (data[i] == SLIP_ESC) {
+      enqueue(SLIP_ESC);
+      enqueue(SLIP_ESC_ESC);
+    } else {
+      enqueue(data[i]);
+    }
+  }
+  enqueue(SLIP_END);
+  _messages++;
+  _queued_max = max(_queued_max, _count);
+
+  // straight out if the connection is free, otherwise it goes with whatever
+  // else is queued by then
+  if (_state == TCP_CONNECTED) {
+    flush();
+  }
+  return true;
+}
+
+void TargetStream::flush() {
+  uint16_t length = min(min((uint16_t)(_count - _sent), hw_writable()), (uint16_t)STREAM_WRITE_MAX);
+  if (length == 0) {
+    return;
+  }
+
+  // the queue wraps, so this is one or two writes, then one send
+  uint16_t start = (_tail + _sent) % STREAM_QUEUE_SIZE;
+  uint16_t first = min(length, (uint16_t)(STREAM_QUEUE_SIZE - start));
+  hw_write(_queue + start, first);
+  if (length > first) {
+    hw_write(_queue, length - first);
+  }
+  hw_send();
+
+  _sent += length;
+  _writes++;
+}
+
+void TargetStream::release(const uint16_t acked) {
+  // only whole messages are let go (every second END closes one), so a
+  // rewrite after a reconnect starts on a frame
+  uint16_t done = 0;
+  uint8_t ends = 0;
+  for (uint16_t i = 0; i < acked; i++) {
+    if (_queue[(_tail + i) % STREAM_QUEUE_SIZE] == SLIP_END && ++ends == 2) {
+      ends = 0;
+      done = i + 1;
+    }
+  }
+
+  _tail = (_tail + done) % STREAM_QUEUE_SIZE;
+  _count -= done;
+  _sent -= done;
+}
+
+void TargetStream::set_state(const TCPState state) {
+  _state = state;
+  _state_ms = millis();
+}
+
+void TargetStream::closed(const bool failed) {
+  hw_close();
+  set_state(TCP_CLOSED);
+  // anything not ACKed is written again on the next connection
+  _sent = 0;
+
+  // a connection that was up for a while is retried straight away, failed
+  // attempts (and connections dropped soon after they were made) back off
+  if (failed) {
+    _retry_ms = min(max(_retry_ms * 2, (unsigned long)STREAM_RETRY_MIN_MS), (unsigned long)STREAM_RETRY_MAX_MS);
+  } else {
+    _retry_ms = 0;
+  }
+}
+
+void TargetStream::loop() {
+  unsigned long now = millis();
+
+  switch (_state) {
+    case TCP_CLOSED:
+      if ((now - _state_ms) >= _retry_ms) {
+        if (hw_connect()) {
+          set_state(TCP_CONNECTING);
+        } else {
+          closed(true);
+        }
+      }
+      break;
+
+    case TCP_CONNECTING:
+      if ((now - _last_poll) >= STREAM_POLL_MS) {
+        _last_poll = now;
+        TCPState state = hw_state();
+        if (state == TCP_CONNECTED) {
+          Log.trace(F("STREAM: connected to "));
+          Log.trace(_ip);
+          Log.traceln(F(":%u (%d bytes queued)"), (unsigned long)_port, _count);
+          set_state(TCP_CONNECTED);
+          _connects++;
+        } else if (state == TCP_CLOSED || (now - _state_ms) >= STREAM_CONNECT_TIMEOUT_MS) {
+          closed(true);
+        }
+      }
+      break;
+
+    case TCP_CONNECTED:
+      if ((now - _last_poll) >= STREAM_POLL_MS) {
+        _last_poll = now;
+        if (hw_state() != TCP_CONNECTED) {
+          Log.errorln(F("STREAM: connection to port %u lost, reconnecting (%d bytes queued)"), (unsigned long)_port, _count);
+          _disconnects++;
+          closed((now - _state_ms) < STREAM_STABLE_MS);
+          break;
+        }
+        if (_sent) {
+          uint16_t unacked = hw_unacked();
+          if (unacked < _sent) {
+            release(_sent - unacked);
+          }
+        }
+      }
+      // anything queued while the last write was going out
+      if (_count > _sent) {
+        flush();
+      }
+      break;
+  }
+}
+
+void TargetStream::log_stats() {
+  Log.trace(F("STREAM: "));
+  Log.trace(_ip);
+  Log.traceln(F(":%u connected=%d messages=%u dropped=%u writes=%u connects=%u disconnects=%u queued=%u (max=%u)"),
+              (unsigned long)_port, connected(), _messages, _dropped, _writes, _connects, _disconnects,
+              (unsigned long)_count, (unsigned long)_queued_max);
+  _queued_max = _count;
+}
+
+// Socket Stream
+SocketStream::SocketStream(SocketPool *pool, TCPSocket *socket) : TargetStream(socket->ip(), socket->port()), _pool(pool), _socket(socket)
+{
+}
+
+SocketStream::~SocketStream() {
+  _pool->close(_socket);
+}
+
+uint8_t SocketStream::socket() {
+  return _socket->socket();
+}
+
+bool SocketStream::hw_connect() {
+  // a new local port each time, so the old connection can't be confused with it
+  return _socket->connect(_pool->next_port());
+}
+
+TCPState SocketStream::hw_state() {
+  return _socket->state();
+}
+
+uint16_t SocketStream::hw_writable() {
+  return _socket->writable();
+}
+
+uint16_t SocketStream::hw_unacked() {
+  return _socket->unacked();
+}
+
+void SocketStream::hw_write(const uint8_t *data, const uint16_t length) {
+  _socket->queue(data, length);
+}
+
+void SocketStream::hw_send() {
+  _socket->transmit();
+}
+
+void SocketStream::hw_close() {
+  _socket->disconnect();
+}
@@ -0,0 +1,132 @@
+#ifndef _TargetStream_H
+#define _TargetStream_H
+
+#include <Arduino.h>
+#include "TargetSocket.h"
+
+// bytes of framed messages kept while the connection is down or busy
+#if defined(__AVR__)
+#define STREAM_QUEUE_SIZE 256
+#else
+#define STREAM_QUEUE_SIZE 1024
+#endif
+// most bytes handed to the connection in one write
+#define STREAM_WRITE_MAX 1460
+// how long a connection attempt can take, and how long to wait before the
+// next (doubling after each failure, up to the max)
+#define STREAM_CONNECT_TIMEOUT_MS 3000
+#define STREAM_RETRY_MIN_MS 250
+#define STREAM_RETRY_MAX_MS 8000
+// how long a connection has to stay up before a drop is retried straight away
+// (a peer that accepts and then closes at once is backed off like a failure)
+#define STREAM_STABLE_MS STREAM_RETRY_MAX_MS
+// how often the connection is checked
+#define STREAM_POLL_MS 20
+
+// SLIP framing (RFC 1055, with an END before each message too, as in OSC 1.1)
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+// target transports
+typedef enum target_transport {
+  TRANSPORT_UDP,
+  TRANSPORT_TCP
+} TargetTransport;
+
+// TargetStream - OSC 1.1 (SLIP framed) over a persistent TCP connection to one
+// target. send() only queues the message, and loop() connects, reconnects
+// and writes out everything queued in one go, so a press never waits on the
+// connection and presses made while it is down go out once it is back.
+// Messages stay queued until the target has ACKed them and are written again
+// after a reconnect, so one may arrive twice but none are lost silently.
+class TargetStream
+{
+private:
+  const IPAddress _ip;
+  const uint16_t _port;
+
+  // SLIP framed messages waiting to be written - the first _sent bytes have
+  // been written, and are kept until the target has ACKed them so they can be
+  // written again if the connection drops first
+  uint8_t _queue[STREAM_QUEUE_SIZE];
+  uint16_t _tail;
+  uint16_t _count;
+  uint16_t _sent;
+
+  TCPState _state;
+  unsigned long _state_ms;
+  unsigned long _retry_ms;
+  unsigned long _last_poll;
+
+  // stats
+  unsigned long _messages;
+  unsigned long _dropped;
+  unsigned long _writes;
+  unsigned long _connects;
+  unsigned long _disconnects;
+  uint16_t _queued_max;
+
+  void enqueue(const uint8_t c);
+  void set_state(const TCPState state);
+  void closed(const bool failed);
+  void flush();
+  void release(const uint16_t acked);
+
+public:
+  TargetStream(const IPAddress &ip, const uint16_t port);
+  virtual ~TargetStream() {}
+
+  // queues a message to be sent (false if there isn't room for it)
+  bool send(const uint8_t *data, const uint16_t length);
+
+  // accessors
+  IPAddress ip();
+  uint16_t port();
+  bool connected();
+
+  // counters
+  unsigned long messages();
+  unsigned long dropped();
+  unsigned long connects();
+
+  // eventloop function
+  void loop();
+
+  void log_stats();
+
+  // functions implemented by the connection types
+  virtual bool hw_connect() = 0;
+  virtual TCPState hw_state() = 0;
+  virtual uint16_t hw_writable() = 0;
+  virtual uint16_t hw_unacked() = 0;
+  virtual void hw_write(const uint8_t *data, const uint16_t length) = 0;
+  virtual void hw_send() {}
+  virtual void hw_close() = 0;
+};
+
+// SocketStream - a TargetStream on a W5x00 socket from the pool, driven
+// through the socket registers so connecting never blocks
+class SocketStream : public TargetStream
+{
+private:
+  SocketPool *_pool;
+  TCPSocket *_socket;
+
+public:
+  SocketStream(SocketPool *pool, TCPSocket *socket);
+  ~SocketStream();
+
+  uint8_t socket();
+
+  bool hw_connect();
+  TCPState hw_state();
+  uint16_t hw_writable();
+  uint16_t hw_unacked();
+  void hw_write(const uint8_t *data, const uint16_t length);
+  void hw_send();
+  void hw_close();
+};
+
+#endif
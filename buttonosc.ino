@@ -5,6 +5,29 @@
 #include "ButtonOSC.h"
 
 ButtonOSC *buttonOSC;
+Config *config;
+
+// loads a new configuration (inline, or from the running configuration's file)
+// and switches to it if it is valid and can be applied without a restart
+void reload_config(const char *json) {
+  Config *next;
+  if (json) {
+    next = new Config(json, false);
+  } else if (config->file()) {
+    next = new Config(config->file(), true);
+  } else {
+    Log.errorln(F("CONFIG: no configuration file to reload"));
+    return;
+  }
+
+  if (next->parse_json() && buttonOSC->reload(next)) {
+    delete config;
+    config = next;
+  } else {
+    Log.errorln(F("CONFIG: reload failed, keeping the running configuration"));
+    delete next;
+  }
+}
 
 // setup
 void setup() {
@@ -118,8 +141,11 @@ const char *json1 = R"(
 }
 )";
 
-  Config *config = new Config(json, false);
-  config->parse_json();
+  config = new Config(json, false);
+  if (!config->parse_json()) {
+    Log.errorln(F("CONFIG: unable to load the configuration"));
+    while(1);
+  }
 
   // setup networking
   NetworkType network_type = network_setup(config);
@@ -135,6 +161,14 @@ void loop() {
   // buttonOSC loop
   buttonOSC->loop();
 
+  // reload the configuration when asked to over OSC, or when its file changes
+  const char *json;
+  if (buttonOSC->reload_requested(&json)) {
+    reload_config(json);
+  } else if (config->file_changed()) {
+    reload_config(NULL);
+  }
+
   // handle network loop
   network_loop();
 }
\ No newline at end of file
@@ -0,0 +1,744 @@
+// loadgen - replays recorded or synthetic button press traces into the
+// simulated inputs of the real Button/ButtonOSC sources, and measures what
+// arrives at a local OSC sink.
+//
+// Trace files have one press per line: "<time_ms> <button_id>", with blank
+// lines and lines starting with '#' ignored.
+#include <algorithm>
+#include <arpa/inet.h>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <ArduinoLog.h>
+#include <SD.h>
+#include <utility/w5100.h>
+#include "ButtonOSC.h"
+#include "rf.h"
+#include "sink.h"
+#include "sntp.h"
+
+// wired buttons use pins from here up, their LEDs from LED_PIN_BASE up
+#define BUTTON_PIN_BASE 128
+#define LED_PIN_BASE 2
+#define HEARTBEAT_PIN 1
+#define MAX_BUTTONS 120
+// a matrix's rows use pins from here up, its columns MATRIX_MAX_ROWS further
+// on (its keys' LEDs still start at LED_PIN_BASE)
+#define MATRIX_PIN_BASE 200
+#define MAX_MATRIX_BUTTONS 128
+// wireless buttons use codes from here up, all on one receiver
+#define BUTTON_CODE_BASE 1000
+#define RF_INTERRUPT 1
+// a wireless remote has to be quiet for this long before a new press counts
+#define WIRELESS_LOCKOUT_MS 150
+// where the sketch listens for commands
+#define COMMAND_PORT 54000
+// the configuration file on the simulated SD card, and how often the sketch
+// checks it for changes (with --reload-file)
+#define CONFIG_FILE "CONFIG.JSN"
+#define CONFIG_POLL_MS 100
+
+struct Press {
+  unsigned long time_us;
+  unsigned int button;
+};
+
+// a reload made during the replay, and what the sketch did with it
+struct Reload {
+  unsigned long at_ms = 0;
+  bool sent = false;
+  unsigned long sent_us = 0;
+  bool handled = false;
+  bool applied = false;
+  unsigned long received_us = 0;
+  unsigned long apply_us = 0;
+};
+
+struct Options {
+  const char *trace = nullptr;
+  const char *record = nullptr;
+  ButtonType type = BUTTON_WIRED;
+  unsigned int buttons = 8;
+  unsigned int rows = 0;
+  unsigned int cols = 0;
+  unsigned long scan_us = 1000;
+  unsigned int prearm = 0;
+  unsigned int presses = 1000;
+  double rate = 100.0;
+  unsigned long hold_ms = 30;
+  unsigned long drain_ms = 500;
+  unsigned long warmup_ms = 250;
+  unsigned long reload_ms = 0;
+  unsigned long reload_file_ms = 0;
+  unsigned long reload_invalid_ms = 0;
+  unsigned long timetag_ms = 0;
+  unsigned short sntp_port = 11123;
+  double sntp_offset_ms = 250.0;
+  double sntp_drift_ppm = 50.0;
+  unsigned long sntp_poll_ms = 1000;
+  bool tcp = false;
+  unsigned long disconnect_ms = 0;
+  unsigned short port = 53000;
+  unsigned int seed = 1;
+};
+
+static void usage() {
+  fprintf(stderr,
+    "usage: loadgen [options]\n"
+    "  --trace FILE     replay presses from FILE instead of generating them\n"
+    "  --record FILE    write the (generated) trace to FILE\n"
+    "  --type TYPE      button type, wired or wireless (default wired)\n"
+    "  --buttons N      number of buttons (default 8, max %d)\n"
+    "  --matrix RxC     use an R row by C column key matrix instead, one button per\n"
+    "                   key (at most %dx%d and %d keys)\n"
+    "  --scan US        how often the matrix is scanned (default 1000)\n"
+    "  --prearm N       mark the first N buttons 'prearm' (default 0)\n"
+    "  --presses N      number of generated presses (default 1000)\n"
+    "  --rate HZ        generated press rate across all buttons (default 100)\n"
+    "  --hold MS        how long wired presses are held (default 30)\n"
+    "  --drain MS       time to wait for late packets (default 500)\n"
+    "  --warmup MS      time to run the sketch before replaying (default 250)\n"
+    "  --reload MS      send a reload over OSC, with the document inline, this far\n"
+    "                   into the replay (it renames button 0; default 0, no reload)\n"
+    "  --reload-file MS start from a configuration file on the simulated SD card\n"
+    "                   and rewrite it (renaming button 0) this far into the replay,\n"
+    "                   for the sketch to pick up (default 0, no reload)\n"
+    "  --reload-invalid MS send a reload with a document that fails validation this\n"
+    "                   far into the replay, which must be rejected (default 0)\n"
+    "  --timetag MS     send bundles timetagged MS after the press, with the clock\n"
+    "                   kept by a local SNTP stand-in (default 0, plain messages)\n"
+    "  --sntp-port PORT SNTP stand-in port (default 11123)\n"
+    "  --sntp-offset MS how far the SNTP reference is ahead of the host (default 250)\n"
+    "  --sntp-drift PPM how fast the SNTP reference runs against the host (default 50)\n"
+    "  --sntp-poll MS   how often the sketch polls the stand-in (default 1000)\n"
+    "  --tcp            send to the sink over TCP (SLIP framed) instead of UDP\n"
+    "  --disconnect MS  with --tcp, have the sink drop the connection this far into\n"
+    "                   the replay (default 0, never)\n"
+    "  --port PORT      sink port (default 53000)\n"
+    "  --seed N         random seed (default 1)\n", MAX_BUTTONS, MATRIX_MAX_ROWS, MATRIX_MAX_COLS, MAX_MATRIX_BUTTONS);
+  exit(2);
+}
+
+static Options parse_options(int argc, char **argv) {
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--tcp") == 0) {
+      // the only option without a value
+      options.tcp = true;
+      continue;
+    }
+    if (value == nullptr) {
+      usage();
+    }
+    if (strcmp(arg, "--trace") == 0) {
+      options.trace = value;
+    } else if (strcmp(arg, "--record") == 0) {
+      options.record = value;
+    } else if (strcmp(arg, "--type") == 0) {
+      if (strcmp(value, "wired") == 0) {
+        options.type = BUTTON_WIRED;
+      } else if (strcmp(value, "wireless") == 0) {
+        options.type = BUTTON_WIRELESS;
+      } else {
+        usage();
+      }
+    } else if (strcmp(arg, "--buttons") == 0) {
+      options.buttons = atoi(value);
+    } else if (strcmp(arg, "--matrix") == 0) {
+      if (sscanf(value, "%ux%u", &options.rows, &options.cols) != 2) {
+        usage();
+      }
+      options.type = BUTTON_MATRIX;
+    } else if (strcmp(arg, "--scan") == 0) {
+      options.scan_us = atol(value);
+    } else if (strcmp(arg, "--prearm") == 0) {
+      options.prearm = atoi(value);
+    } else if (strcmp(arg, "--presses") == 0) {
+      options.presses = atoi(value);
+    } else if (strcmp(arg, "--rate") == 0) {
+      options.rate = atof(value);
+    } else if (strcmp(arg, "--hold") == 0) {
+      options.hold_ms = atol(value);
+    } else if (strcmp(arg, "--drain") == 0) {
+      options.drain_ms = atol(value);
+    } else if (strcmp(arg, "--warmup") == 0) {
+      options.warmup_ms = atol(value);
+    } else if (strcmp(arg, "--reload") == 0) {
+      options.reload_ms = atol(value);
+    } else if (strcmp(arg, "--reload-file") == 0) {
+      options.reload_file_ms = atol(value);
+    } else if (strcmp(arg, "--reload-invalid") == 0) {
+      options.reload_invalid_ms = atol(value);
+    } else if (strcmp(arg, "--timetag") == 0) {
+      options.timetag_ms = atol(value);
+    } else if (strcmp(arg, "--sntp-port") == 0) {
+      options.sntp_port = atoi(value);
+    } else if (strcmp(arg, "--sntp-offset") == 0) {
+      options.sntp_offset_ms = atof(value);
+    } else if (strcmp(arg, "--sntp-drift") == 0) {
+      options.sntp_drift_ppm = atof(value);
+    } else if (strcmp(arg, "--sntp-poll") == 0) {
+      options.sntp_poll_ms = atol(value);
+    } else if (strcmp(arg, "--disconnect") == 0) {
+      options.disconnect_ms = atol(value);
+    } else if (strcmp(arg, "--port") == 0) {
+      options.port = atoi(value);
+    } else if (strcmp(arg, "--seed") == 0) {
+      options.seed = atoi(value);
+    } else {
+      usage();
+    }
+    i++;
+  }
+
+  if (options.type == BUTTON_MATRIX) {
+    if (options.rows == 0 || options.rows > MATRIX_MAX_ROWS || options.cols == 0 || options.cols > MATRIX_MAX_COLS ||
+        options.rows * options.cols > MAX_MATRIX_BUTTONS) {
+      usage();
+    }
+    options.buttons = options.rows * options.cols;
+  }
+
+  if (options.buttons == 0 || (options.type != BUTTON_MATRIX && options.buttons > MAX_BUTTONS) || options.scan_us == 0 || options.rate <= 0 || (options.disconnect_ms && !options.tcp)) {
+    usage();
+  }
+
+  return options;
+}
+
+static std::vector<Press> load_trace(const Options &options) {
+  std::vector<Press> trace;
+  std::ifstream file(options.trace);
+  std::string line;
+
+  if (!file) {
+    fprintf(stderr, "loadgen: unable to open trace %s\n", options.trace);
+    exit(1);
+  }
+
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    double time_ms;
+    unsigned int button;
+    if (!(fields >> time_ms >> button) || button >= options.buttons) {
+      fprintf(stderr, "loadgen: bad trace line: %s\n", line.c_str());
+      exit(1);
+    }
+    trace.push_back({ (unsigned long)(time_ms * 1000), button });
+  }
+
+  std::stable_sort(trace.begin(), trace.end(), [](const Press &a, const Press &b) { return a.time_us < b.time_us; });
+  return trace;
+}
+
+// presses at a fixed rate, each on a random button that is free to be pressed
+// again (a held wired button, or a wireless one still in its lockout, would
+// not register a human press either) - wireless presses also wait for the
+// last one to finish sending, as two remotes at once would garble each other
+static std::vector<Press> generate_trace(const Options &options) {
+  std::vector<Press> trace;
+  std::vector<unsigned long> free_at(options.buttons, 0);
+  std::mt19937 rng(options.seed);
+  unsigned long busy_us = (options.type == BUTTON_WIRELESS ? WIRELESS_LOCKOUT_MS + 10 : options.hold_ms * 2) * 1000;
+  double interval_us = 1000000.0 / options.rate;
+  unsigned long time_us = 0;
+  unsigned long air_free_at = 0;
+
+  for (unsigned int i = 0; i < options.presses; i++) {
+    time_us = max(time_us, (unsigned long)(i * interval_us));
+
+    // pick a random free button, or wait for the first one to free up
+    unsigned int start = rng() % options.buttons;
+    unsigned int button = start;
+    for (unsigned int j = 0; j < options.buttons; j++) {
+      unsigned int candidate = (start + j) % options.buttons;
+      if (free_at[candidate] <= time_us) {
+        button = candidate;
+        break;
+      }
+      if (free_at[candidate] < free_at[button]) {
+        button = candidate;
+      }
+    }
+    time_us = max(time_us, free_at[button]);
+    if (options.type == BUTTON_WIRELESS) {
+      time_us = max(time_us, air_free_at);
+      air_free_at = time_us + RFTransmitter::air_us();
+    }
+    free_at[button] = time_us + busy_us;
+
+    trace.push_back({ time_us, button });
+  }
+
+  return trace;
+}
+
+static void record_trace(const char *filename, const std::vector<Press> &trace) {
+  FILE *file = fopen(filename, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "loadgen: unable to write trace %s\n", filename);
+    exit(1);
+  }
+  fprintf(file, "# time_ms button_id\n");
+  for (const Press &press : trace) {
+    fprintf(file, "%.3f %u\n", press.time_us / 1000.0, press.button);
+  }
+  fclose(file);
+}
+
+// closes or opens a wired button's contact, or a matrix key's
+static void set_pressed(const Options &options, unsigned int button, bool pressed) {
+  if (options.type == BUTTON_MATRIX) {
+    sim_set_switch(MATRIX_PIN_BASE + button / options.cols, MATRIX_PIN_BASE + MATRIX_MAX_ROWS + button % options.cols, pressed);
+  } else {
+    sim_set_pin(BUTTON_PIN_BASE + button, pressed ? LOW : HIGH);
+  }
+}
+
+// the OSC address button i sends (button 0 is renamed by a reload)
+static std::string button_address(unsigned int i, bool reloaded) {
+  return std::string(reloaded && i == 0 ? "/loadgen/reloaded/" : "/loadgen/") + std::to_string(i);
+}
+
+// the configuration document the sketch is started (or reloaded) with, kept
+// compact so the reload fits in one datagram - reloaded renames button 0, and
+// invalid points it at a target that doesn't exist
+static std::string config_document(const Options &options, bool reloaded, bool invalid = false) {
+  std::ostringstream json;
+
+  json << "{\"misc\":{\"heartbeat_pin\":" << HEARTBEAT_PIN;
+  if (options.reload_file_ms) {
+    json << ",\"config_poll_ms\":" << CONFIG_POLL_MS;
+  }
+  json << "},\"network\":{\"ethernet\":{\"mac\":\"DE:AD:BE:EF:FE:ED\"}},";
+  if (options.timetag_ms) {
+    json << "\"time\":{\"server\":\"127.0.0.1\",\"port\":" << options.sntp_port << ",\"poll_ms\":" << options.sntp_poll_ms << "},";
+  }
+  json << "\"targets\":[{\"id\":0,\"server\":\"127.0.0.1\",\"port\":" << options.port;
+  if (options.timetag_ms) {
+    json << ",\"timetag_ms\":" << options.timetag_ms;
+  }
+  if (options.tcp) {
+    json << ",\"transport\":\"tcp\"";
+  }
+  json << "}],";
+  if (options.type == BUTTON_MATRIX) {
+    // the simulated keys act as if they had diodes (see sim_set_switch())
+    json << "\"matrices\":[{\"id\":0,\"row_pins\":[";
+    for (unsigned int row = 0; row < options.rows; row++) {
+      json << (row ? "," : "") << MATRIX_PIN_BASE + row;
+    }
+    json << "],\"col_pins\":[";
+    for (unsigned int col = 0; col < options.cols; col++) {
+      json << (col ? "," : "") << MATRIX_PIN_BASE + MATRIX_MAX_ROWS + col;
+    }
+    json << "],\"scan_us\":" << options.scan_us << ",\"diodes\":true}],";
+  }
+  json << "\"buttons\":[";
+
+  for (unsigned int i = 0; i < options.buttons; i++) {
+    json << (i ? "," : "") << "{\"id\":" << i;
+    if (options.type == BUTTON_WIRED) {
+      json << ",\"button_type\":\"wired\",\"button_pin\":" << BUTTON_PIN_BASE + i;
+    } else if (options.type == BUTTON_MATRIX) {
+      json << ",\"button_type\":\"matrix\",\"matrix\":0,\"button_row\":" << i / options.cols << ",\"button_col\":" << i % options.cols;
+    } else {
+      json << ",\"button_type\":\"wireless\",\"button_intr\":" << RF_INTERRUPT << ",\"button_code\":" << BUTTON_CODE_BASE + i;
+    }
+    json << ",\"led_pin\":" << LED_PIN_BASE + i << ",\"osc_string\":\"" << button_address(i, reloaded)
+         << "\",\"target\":" << (invalid && i == 0 ? 1 : 0);
+    if (i < options.prearm) {
+      json << ",\"prearm\":true";
+    }
+    json << "}";
+  }
+  json << "]}";
+
+  return json.str();
+}
+
+static void write_file(const std::string &path, const std::string &contents) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr || fwrite(contents.data(), 1, contents.size(), file) != contents.size()) {
+    fprintf(stderr, "loadgen: unable to write %s\n", path.c_str());
+    exit(1);
+  }
+  fclose(file);
+}
+
+// switches the sketch to a new configuration the way buttonosc.ino does,
+// freeing whichever of the two configurations is no longer used
+static bool reload_config(ButtonOSC *buttonOSC, Config **config, const char *json) {
+  if (json == nullptr && (*config)->file() == nullptr) {
+    return false;
+  }
+  Config *next = json ? new Config(json, false) : new Config((*config)->file(), true);
+  if (next->parse_json() && buttonOSC->reload(next)) {
+    delete *config;
+    *config = next;
+    return true;
+  }
+  delete next;
+  return false;
+}
+
+// the OSC reload command carrying document
+static std::vector<uint8_t> reload_command(const std::string &document) {
+  OSCMessage msg(COMMAND_RELOAD);
+  msg.add(document.c_str());
+  return msg.encode();
+}
+
+// sends a reload command to the sketch, as a show controller would
+static void send_reload(const std::vector<uint8_t> &packet) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(COMMAND_PORT);
+  if (fd < 0 || sendto(fd, packet.data(), packet.size(), 0, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "loadgen: unable to send the reload command\n");
+    exit(1);
+  }
+  close(fd);
+}
+
+static void report_reload(const char *label, const Reload &reload, bool valid, const char *sent) {
+  if (!reload.at_ms) {
+    return;
+  }
+  if (!reload.sent) {
+    printf("%-11s not made (the replay ended first)\n", label);
+  } else if (!reload.handled) {
+    printf("%-11s not picked up by the sketch\n", label);
+  } else if (reload.applied != valid) {
+    printf("%-11s %s, but it should have been %s\n", label, reload.applied ? "applied" : "rejected", valid ? "applied" : "rejected");
+  } else {
+    printf("%-11s picked up %luus after it was %s, %s in %luus\n", label, reload.received_us, sent,
+           valid ? "applied" : "rejected (running configuration kept)", reload.apply_us);
+  }
+}
+
+static bool reload_failed(const Reload &reload, bool valid) {
+  return reload.at_ms && (!reload.handled || reload.applied != valid);
+}
+
+static unsigned long percentile(const std::vector<unsigned long> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[min(index, sorted.size() - 1)];
+}
+
+// the sketch's state, kept where LeakSanitizer can see it - an ASAN=1 build
+// reports anything else left allocated at exit (such as a configuration a
+// reload didn't free)
+static ButtonOSC *buttonOSC;
+static Config *config;
+
+int main(int argc, char **argv) {
+  Options options = parse_options(argc, argv);
+  Log.begin(LOG_LEVEL_ERROR);
+
+  // the trace to replay
+  std::vector<Press> trace = options.trace ? load_trace(options) : generate_trace(options);
+  if (options.record) {
+    record_trace(options.record, trace);
+  }
+
+  // start the sink (and time server), then the sketch
+  OSCSink sink;
+  if (!sink.begin(options.port, options.tcp)) {
+    fprintf(stderr, "loadgen: unable to listen on port %u\n", options.port);
+    return 1;
+  }
+  SNTPServer sntp;
+  if (options.timetag_ms && !sntp.begin(options.sntp_port, options.sntp_offset_ms, options.sntp_drift_ppm)) {
+    fprintf(stderr, "loadgen: unable to listen on port %u\n", options.sntp_port);
+    return 1;
+  }
+
+  // the configuration, inline or from a file on the simulated card, parsed by
+  // the sketch's own Config
+  std::string document = config_document(options, false);
+  char sd_root[] = "/tmp/loadgen-XXXXXX";
+  std::string config_path;
+  if (options.reload_file_ms) {
+    if (mkdtemp(sd_root) == nullptr) {
+      fprintf(stderr, "loadgen: unable to create the SD card directory\n");
+      return 1;
+    }
+    sim_sd_root(sd_root);
+    config_path = std::string(sd_root) + "/" + CONFIG_FILE;
+    write_file(config_path, document);
+    config = new Config(CONFIG_FILE, true);
+  } else {
+    config = new Config(document.c_str(), false);
+  }
+  if (!config->parse_json()) {
+    fprintf(stderr, "loadgen: the sketch didn't accept the configuration\n");
+    return 1;
+  }
+  buttonOSC = new ButtonOSC(config, WIRED);
+
+  // the reloads, with their documents sent inline
+  Reload inline_reload, file_reload, invalid_reload;
+  inline_reload.at_ms = options.reload_ms;
+  file_reload.at_ms = options.reload_file_ms;
+  invalid_reload.at_ms = options.reload_invalid_ms;
+  std::string invalid_document = config_document(options, false, true);
+  std::vector<uint8_t> inline_command = reload_command(config_document(options, true));
+  std::vector<uint8_t> invalid_command = reload_command(invalid_document);
+  if ((options.reload_ms && inline_command.size() > COMMAND_MAX_SIZE) ||
+      (options.reload_invalid_ms && invalid_command.size() > COMMAND_MAX_SIZE)) {
+    fprintf(stderr, "loadgen: the reload document doesn't fit in one command (%zu bytes, max %d), use --reload-file\n",
+            max(inline_command.size(), invalid_command.size()), COMMAND_MAX_SIZE);
+    return 2;
+  }
+
+  // on hardware the network setup takes seconds, so the sketch has been up for
+  // a while before the first press can arrive
+  unsigned long warmup_until = micros() + options.warmup_ms * 1000;
+  while (micros() < warmup_until) {
+    buttonOSC->loop();
+  }
+
+  // replay
+  std::vector<unsigned long> press_us;
+  std::vector<unsigned int> press_button;
+  std::vector<unsigned long> release_at(options.buttons, 0);
+  RFTransmitter transmitter(RF_INTERRUPT);
+  unsigned long overlapped = 0;
+  unsigned long loops = 0;
+  bool disconnected = false;
+  size_t next = 0;
+  unsigned long start = micros();
+  unsigned long start_accesses = W5100.sim_accesses();
+  unsigned long start_sends = W5100.sim_sends();
+  unsigned long start_send_accesses = W5100.sim_send_accesses();
+
+  while (next < trace.size() || transmitter.busy() || std::any_of(release_at.begin(), release_at.end(), [](unsigned long t) { return t != 0; })) {
+    unsigned long now = micros();
+
+    // inject everything that is due
+    while (next < trace.size() && trace[next].time_us <= now - start) {
+      unsigned int button = trace[next].button;
+      if (options.type != BUTTON_WIRELESS) {
+        if (release_at[button] != 0) {
+          // still held, a second press can't happen
+          overlapped++;
+          next++;
+          continue;
+        }
+        set_pressed(options, button, true);
+        release_at[button] = now + options.hold_ms * 1000;
+      } else {
+        transmitter.send(BUTTON_CODE_BASE + button, now);
+      }
+      press_us.push_back(now);
+      press_button.push_back(button);
+      next++;
+    }
+
+    // edges from the remotes
+    transmitter.loop(now);
+
+    // release wired buttons and matrix keys whose hold is over
+    for (unsigned int i = 0; i < options.buttons; i++) {
+      if (release_at[i] != 0 && now >= release_at[i]) {
+        set_pressed(options, i, false);
+        release_at[i] = 0;
+      }
+    }
+
+    // reload part way through, while presses keep coming
+    if (inline_reload.at_ms && !inline_reload.sent && now - start >= inline_reload.at_ms * 1000) {
+      send_reload(inline_command);
+      inline_reload.sent = true;
+      inline_reload.sent_us = now;
+    }
+    if (invalid_reload.at_ms && !invalid_reload.sent && now - start >= invalid_reload.at_ms * 1000) {
+      send_reload(invalid_command);
+      invalid_reload.sent = true;
+      invalid_reload.sent_us = now;
+    }
+    if (file_reload.at_ms && !file_reload.sent && now - start >= file_reload.at_ms * 1000) {
+      write_file(config_path, config_document(options, true));
+      file_reload.sent = true;
+      file_reload.sent_us = now;
+    }
+
+    // the sink drops the connection part way through, so the sketch has to
+    // reconnect while presses keep coming
+    if (options.disconnect_ms && !disconnected && now - start >= options.disconnect_ms * 1000) {
+      sink.disconnect();
+      disconnected = true;
+    }
+
+    W5100.sim_mark();
+    buttonOSC->loop();
+    loops++;
+
+    // as buttonosc.ino's loop() does
+    const char *json;
+    bool requested = buttonOSC->reload_requested(&json);
+    if (requested || config->file_changed()) {
+      Reload &reload = !requested ? file_reload : (json && invalid_document == json) ? invalid_reload : inline_reload;
+      unsigned long reload_start = micros();
+      reload.applied = reload_config(buttonOSC, &config, requested ? json : nullptr);
+      reload.apply_us = micros() - reload_start;
+      reload.received_us = reload_start - reload.sent_us;
+      reload.handled = true;
+    }
+  }
+  unsigned long end = micros();
+  unsigned long accesses = W5100.sim_accesses() - start_accesses;
+  unsigned long sends = W5100.sim_sends() - start_sends;
+  unsigned long send_accesses = W5100.sim_send_accesses() - start_send_accesses;
+
+  // keep the sketch running while late packets drain
+  unsigned long drain_until = micros() + options.drain_ms * 1000;
+  while (micros() < drain_until) {
+    buttonOSC->loop();
+  }
+  sink.stop();
+
+  // match each packet to the latest press of its button at or before it was
+  // received - a press only ever causes one immediate send, so any earlier
+  // unmatched press of that button was dropped
+  std::vector<SinkPacket> packets = sink.packets();
+  std::map<std::string, unsigned int> buttons;
+  for (unsigned int i = 0; i < options.buttons; i++) {
+    buttons[button_address(i, false)] = i;
+    buttons[button_address(i, true)] = i;
+  }
+  std::vector<std::deque<unsigned long>> outstanding(options.buttons);
+  for (size_t i = 0; i < press_us.size(); i++) {
+    outstanding[press_button[i]].push_back(press_us[i]);
+  }
+
+  std::vector<unsigned long> latencies;
+  std::vector<long> timetag_errors;
+  unsigned long untimed = 0;
+  unsigned long invalid = 0;
+  unsigned long unknown = 0;
+  unsigned long duplicates = 0;
+  unsigned long dropped = 0;
+  for (const SinkPacket &packet : packets) {
+    if (!packet.valid) {
+      invalid++;
+      continue;
+    }
+    auto button = buttons.find(packet.address);
+    if (button == buttons.end()) {
+      unknown++;
+      continue;
+    }
+    std::deque<unsigned long> &queue = outstanding[button->second];
+    if (queue.empty() || queue.front() > packet.time_us) {
+      duplicates++;
+      continue;
+    }
+    // tcp delivers in order, so a late message still belongs to the oldest
+    // press rather than meaning the ones before it were lost
+    while (!options.tcp && queue.size() > 1 && queue[1] <= packet.time_us) {
+      queue.pop_front();
+      dropped++;
+    }
+    latencies.push_back(packet.time_us - queue.front());
+    queue.pop_front();
+
+    // a timetag is press time + timetag_ms on the reference clock, and the
+    // packet arrived just after the press was sent
+    if (options.timetag_ms) {
+      if (packet.timetag <= NTP_IMMEDIATE) {
+        untimed++;
+      } else {
+        int64_t error = (int64_t)(packet.timetag - SNTPClock::from_ms(options.timetag_ms) - sntp.reference(packet.time_us));
+        timetag_errors.push_back((long)(error * 1000000 / 4294967296LL));
+      }
+    }
+  }
+
+  for (const std::deque<unsigned long> &queue : outstanding) {
+    dropped += queue.size();
+  }
+
+  // report
+  std::sort(latencies.begin(), latencies.end());
+  double seconds = (end - start) / 1000000.0;
+  double mean = 0;
+  for (unsigned long latency : latencies) {
+    mean += latency;
+  }
+  mean = latencies.empty() ? 0 : mean / latencies.size();
+  size_t pressed = press_us.size();
+
+  printf("presses:    %zu injected, %lu overlapped (not injected)\n", pressed, overlapped);
+  printf("duration:   %.3fs, %.0f loops/s\n", seconds, loops / seconds);
+  printf("packets:    %zu received, %lu invalid, %lu unknown address\n", packets.size(), invalid, unknown);
+  printf("throughput: %.1f presses/s offered, %.1f packets/s delivered\n", pressed / seconds, latencies.size() / seconds);
+  printf("drop rate:  %.2f%% (%lu)\n", pressed ? 100.0 * dropped / pressed : 0.0, dropped);
+  printf("dup rate:   %.2f%% (%lu)\n", pressed ? 100.0 * duplicates / pressed : 0.0, duplicates);
+  printf("w5x00:      %lu direct register/buffer accesses, %.1f per packet, %.1f per send up to its SEND command\n", accesses,
+         latencies.empty() ? 0.0 : (double)accesses / latencies.size(), sends ? (double)send_accesses / sends : 0.0);
+  if (options.type == BUTTON_WIRELESS) {
+    RFReceiver *receiver = buttonOSC->receiver(RF_INTERRUPT);
+    printf("rf:         %lu codes decoded, %lu lost to a full pulse buffer\n",
+           receiver ? receiver->decoded_count() : 0, receiver ? receiver->lost_count() : 0);
+  }
+  if (options.type == BUTTON_MATRIX) {
+    // the bound the sketch works out from its own scan timing, against the
+    // press to packet latencies (which also include the send)
+    ButtonMatrix *matrix = buttonOSC->matrix(0);
+    printf("matrix:     %ux%u scanned every %luus, longest scan %luus, latest %luus; worst case press to event %luus (max press to packet %luus)\n",
+           options.rows, options.cols, options.scan_us, matrix ? matrix->scan_time_max_us() : 0, matrix ? matrix->scan_late_max_us() : 0,
+           matrix ? matrix->worst_case_latency_us() : 0, latencies.empty() ? 0 : latencies.back());
+  }
+  if (options.tcp) {
+    TargetStream *stream = buttonOSC->stream(0);
+    printf("tcp:        %lu connections accepted, %lu connects, %lu messages queued, %lu dropped (queue full)\n",
+           sink.accepted(), stream ? stream->connects() : 0, stream ? stream->messages() : 0, stream ? stream->dropped() : 0);
+  }
+  if (options.timetag_ms) {
+    SNTPClock *clock = buttonOSC->clock();
+    std::vector<unsigned long> errors;
+    double bias = 0;
+    for (long error : timetag_errors) {
+      errors.push_back(labs(error));
+      bias += error;
+    }
+    std::sort(errors.begin(), errors.end());
+    bias = errors.empty() ? 0 : bias / errors.size();
+    printf("clock:      %lu requests answered, %lu samples, last offset %ldus, drift %.2fppm (reference %.2fppm)\n",
+           sntp.requests(), clock ? clock->samples() : 0, clock ? clock->offset_us() : 0,
+           clock ? clock->drift_ppb() / 1000.0 : 0.0, options.sntp_drift_ppm);
+    printf("timetags:   %zu timetagged, %lu immediate; error vs reference p50 %luus p99 %luus max %luus mean %+.0fus\n",
+           timetag_errors.size(), untimed, percentile(errors, 50), percentile(errors, 99), errors.empty() ? 0 : errors.back(), bias);
+  }
+  report_reload("reload:", inline_reload, true, "sent");
+  report_reload("file reload:", file_reload, true, "written");
+  report_reload("bad reload:", invalid_reload, false, "sent");
+  printf("latency:    min %luus p50 %luus p90 %luus p99 %luus max %luus mean %.0fus\n",
+         latencies.empty() ? 0 : latencies.front(), percentile(latencies, 50), percentile(latencies, 90),
+         percentile(latencies, 99), latencies.empty() ? 0 : latencies.back(), mean);
+
+  if (options.reload_file_ms) {
+    unlink(config_path.c_str());
+    rmdir(sd_root);
+  }
+
+  bool reloads_failed = reload_failed(inline_reload, true) || reload_failed(file_reload, true) || reload_failed(invalid_reload, false);
+  return (invalid || unknown || reloads_failed) ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#include "Arduino.h"
+#include "rf.h"
+
+RFTransmitter::RFTransmitter(unsigned char interrupt) : _interrupt(interrupt) {
+}
+
+unsigned long RFTransmitter::air_us() {
+  // each bit is 4 pulses long and the sync 32
+  return (unsigned long)RF_FRAMES * (RF_BITS * 4 + 32) * RF_PULSE_US;
+}
+
+void RFTransmitter::send(unsigned long code, unsigned long now_us) {
+  // a code sent straight after another starts on the edge that ends its sync
+  unsigned long time_us = now_us;
+  if (!_edges.empty() && _edges.back() >= now_us) {
+    time_us = _edges.back();
+    _edges.pop_back();
+  }
+
+  for (int frame = 0; frame < RF_FRAMES; frame++) {
+    for (int bit = RF_BITS - 1; bit >= 0; bit--) {
+      // a one is 3 high and 1 low, a zero 1 high and 3 low
+      unsigned long high = ((code >> bit) & 1) ? 3 : 1;
+      _edges.push_back(time_us);
+      _edges.push_back(time_us + high * RF_PULSE_US);
+      time_us += 4 * RF_PULSE_US;
+    }
+    // sync, 1 high and 31 low
+    _edges.push_back(time_us);
+    _edges.push_back(time_us + RF_PULSE_US);
+    time_us += 32 * RF_PULSE_US;
+  }
+
+  // nothing ends the last sync on air, a real receiver picks up noise soon
+  // after and that edge is what lets the last frame decode
+  _edges.push_back(time_us);
+}
+
+void RFTransmitter::loop(unsigned long now_us) {
+  while (!_edges.empty() && _edges.front() <= now_us) {
+    sim_raise_interrupt_at(_interrupt, _edges.front());
+    _edges.pop_front();
+  }
+}
+
+bool RFTransmitter::busy() const {
+  return !_edges.empty();
+}
@@ -0,0 +1,37 @@
+#ifndef _RF_H
+#define _RF_H
+
+#include <deque>
+
+// the remote's timing (RCSwitch protocol 1, 24 bit codes)
+#define RF_PULSE_US 350
+#define RF_BITS 24
+// frames sent per press (the receiver decodes a frame once the sync after it
+// agrees with the one before, so two is the fewest that get through)
+#define RF_FRAMES 2
+
+// RFTransmitter - sends codes the way a 433MHz remote would, raising the
+// receiver's simulated interrupt on every edge. Edges are raised from loop(),
+// between two loops of the sketch, with micros() reading the time the edge
+// was due, so a slow loop delays the decode but not the timings.
+class RFTransmitter {
+  private:
+    unsigned char _interrupt;
+    std::deque<unsigned long> _edges;
+
+  public:
+    RFTransmitter(unsigned char interrupt);
+
+    // queues a code, sent as soon as anything queued before it has gone
+    void send(unsigned long code, unsigned long now_us);
+
+    // raises every edge that is due
+    void loop(unsigned long now_us);
+
+    bool busy() const;
+
+    // how long one press takes to send
+    static unsigned long air_us();
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Host shim for the parts of the Arduino core used by the sketch. Pins,
+// interrupts and time are simulated so the real Button/ButtonOSC sources can
+// be driven from the load generator.
+#ifndef _Shim_Arduino_H
+#define _Shim_Arduino_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define F(string_literal) (string_literal)
+#define digitalPinToInterrupt(p) (p)
+#define PROGMEM
+#define memcpy_P memcpy
+
+// number of simulated pins
+#define SIM_PIN_COUNT 256
+
+// time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// pins
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+// interrupts
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+// simulation hooks (used by the load generator, not the sketch)
+void sim_set_pin(uint8_t pin, uint8_t value);
+uint8_t sim_get_pin(uint8_t pin);
+// a switch between two pins (a matrix key): while closed, an input reads LOW
+// if the other pin is an output driven LOW (as if each key had a diode)
+void sim_set_switch(uint8_t a, uint8_t b, bool closed);
+void sim_raise_interrupt(uint8_t interrupt);
+// as if the interrupt had run at the given micros() (for edges raised late)
+void sim_raise_interrupt_at(uint8_t interrupt, unsigned long us);
+
+// Print
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+      size_t n = 0;
+      while (size--) {
+        n += write(*buffer++);
+      }
+      return n;
+    }
+};
+
+// Stream
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// String (enough for the to_string() helpers)
+class String {
+  private:
+    std::string _s;
+  public:
+    String() {}
+    String(const char *s) : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned int v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+    String(double v) : _s(std::to_string(v)) {}
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    String &operator+=(const String &rhs) { _s += rhs._s; return *this; }
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs._s + rhs._s); }
+};
+
+#include "IPAddress.h"
+
+#endif
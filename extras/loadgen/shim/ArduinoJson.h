@@ -0,0 +1,378 @@
+// Host shim for ArduinoJson (6.x). A small parser behind the parts of the
+// API Config.cpp uses, with the same conversions and defaults: a missing key
+// reads as null, `|` gives the default when the value is null or of another
+// type, and as<const char*>() on anything but a string is NULL. The document
+// capacity isn't enforced.
+#ifndef _Shim_ArduinoJson_H
+#define _Shim_ArduinoJson_H
+
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct JsonNode {
+  enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+  Type type = NUL;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<std::pair<std::string, JsonNode *>> members;
+  std::vector<JsonNode *> elements;
+};
+
+class JsonObject;
+class JsonArray;
+
+class JsonVariant {
+  private:
+    JsonNode *_node;
+
+  public:
+    JsonVariant(JsonNode *node = nullptr) : _node(node) {}
+
+    bool isNull() const { return _node == nullptr || _node->type == JsonNode::NUL; }
+
+    template <typename T>
+    bool is() const {
+      if (isNull()) {
+        return false;
+      }
+      if constexpr (std::is_same<T, bool>::value) {
+        return _node->type == JsonNode::BOOLEAN;
+      } else if constexpr (std::is_arithmetic<T>::value || std::is_enum<T>::value) {
+        return _node->type == JsonNode::NUMBER;
+      } else if constexpr (std::is_same<T, const char *>::value) {
+        return _node->type == JsonNode::STRING;
+      } else {
+        return true;
+      }
+    }
+
+    template <typename T>
+    T as() const;
+
+    template <typename T>
+    operator T() const { return as<T>(); }
+
+    template <typename T>
+    T operator|(T fallback) const { return is<T>() ? as<T>() : fallback; }
+
+    JsonVariant operator[](const char *key) const;
+};
+
+class JsonObject {
+  private:
+    JsonNode *_node;
+
+  public:
+    JsonObject(JsonNode *node = nullptr) : _node(node && node->type == JsonNode::OBJECT ? node : nullptr) {}
+
+    bool operator==(std::nullptr_t) const { return _node == nullptr; }
+    bool operator!=(std::nullptr_t) const { return _node != nullptr; }
+
+    bool containsKey(const char *key) const {
+      if (_node) {
+        for (auto &member : _node->members) {
+          if (member.first == key) {
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
+    JsonVariant operator[](const char *key) const {
+      if (_node) {
+        for (auto &member : _node->members) {
+          if (member.first == key) {
+            return JsonVariant(member.second);
+          }
+        }
+      }
+      return JsonVariant();
+    }
+};
+
+class JsonArray {
+  private:
+    JsonNode *_node;
+
+  public:
+    class iterator {
+      private:
+        std::vector<JsonNode *>::const_iterator _it;
+      public:
+        iterator(std::vector<JsonNode *>::const_iterator it) : _it(it) {}
+        JsonVariant operator*() const { return JsonVariant(*_it); }
+        iterator &operator++() { ++_it; return *this; }
+        bool operator!=(const iterator &other) const { return _it != other._it; }
+    };
+
+    JsonArray(JsonNode *node = nullptr) : _node(node && node->type == JsonNode::ARRAY ? node : nullptr) {}
+
+    bool operator==(std::nullptr_t) const { return _node == nullptr; }
+    bool operator!=(std::nullptr_t) const { return _node != nullptr; }
+
+    size_t size() const { return _node ? _node->elements.size() : 0; }
+
+    iterator begin() const { static const std::vector<JsonNode *> none; return iterator(_node ? _node->elements.begin() : none.begin()); }
+    iterator end() const { static const std::vector<JsonNode *> none; return iterator(_node ? _node->elements.end() : none.end()); }
+};
+
+template <typename T>
+T JsonVariant::as() const {
+  if constexpr (std::is_same<T, JsonObject>::value) {
+    return JsonObject(_node);
+  } else if constexpr (std::is_same<T, JsonArray>::value) {
+    return JsonArray(_node);
+  } else if constexpr (std::is_same<T, JsonVariant>::value) {
+    return *this;
+  } else if constexpr (std::is_same<T, const char *>::value) {
+    return is<const char *>() ? _node->string.c_str() : nullptr;
+  } else if constexpr (std::is_same<T, bool>::value) {
+    return is<bool>() ? _node->boolean : (is<int>() && _node->number != 0);
+  } else {
+    if (is<bool>()) {
+      return (T)_node->boolean;
+    }
+    return is<T>() ? (T)(long long)_node->number : (T)0;
+  }
+}
+
+inline JsonVariant JsonVariant::operator[](const char *key) const {
+  return as<JsonObject>()[key];
+}
+
+class DynamicJsonDocument {
+  private:
+    std::deque<JsonNode> _nodes;
+    JsonNode *_root;
+
+    friend class JsonParser;
+
+  public:
+    DynamicJsonDocument(size_t capacity) : _root(nullptr) { (void)capacity; }
+    DynamicJsonDocument(const DynamicJsonDocument &) = delete;
+    DynamicJsonDocument &operator=(const DynamicJsonDocument &) = delete;
+
+    template <typename T>
+    T as() const { return JsonVariant(_root).as<T>(); }
+};
+
+class DeserializationError {
+  public:
+    enum Code { Ok, IncompleteInput, InvalidInput };
+
+  private:
+    Code _code;
+
+  public:
+    DeserializationError(Code code = Ok) : _code(code) {}
+    explicit operator bool() const { return _code != Ok; }
+    Code code() const { return _code; }
+};
+
+// recursive descent over the input, building the nodes in the document
+class JsonParser {
+  private:
+    DynamicJsonDocument &_doc;
+    const char *_p;
+    DeserializationError::Code _error;
+
+    void skip() {
+      while (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r') {
+        _p++;
+      }
+    }
+
+    bool fail(DeserializationError::Code code) {
+      if (_error == DeserializationError::Ok) {
+        _error = code;
+      }
+      return false;
+    }
+
+    bool literal(const char *word) {
+      size_t length = strlen(word);
+      if (strncmp(_p, word, length) != 0) {
+        return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+      }
+      _p += length;
+      return true;
+    }
+
+    bool string(std::string &out) {
+      _p++;
+      while (*_p != '"') {
+        if (*_p == '\0') {
+          return fail(DeserializationError::IncompleteInput);
+        }
+        if (*_p != '\\') {
+          out += *_p++;
+          continue;
+        }
+        _p++;
+        switch (*_p) {
+          case '"': out += '"'; break;
+          case '\\': out += '\\'; break;
+          case '/': out += '/'; break;
+          case 'b': out += '\b'; break;
+          case 'f': out += '\f'; break;
+          case 'n': out += '\n'; break;
+          case 'r': out += '\r'; break;
+          case 't': out += '\t'; break;
+          case 'u': {
+            char hex[5] = { 0 };
+            for (int i = 0; i < 4; i++) {
+              if (!isxdigit((unsigned char)_p[1 + i])) {
+                return fail(DeserializationError::InvalidInput);
+              }
+              hex[i] = _p[1 + i];
+            }
+            unsigned long code = strtoul(hex, nullptr, 16);
+            if (code < 0x80) {
+              out += (char)code;
+            } else if (code < 0x800) {
+              out += (char)(0xC0 | (code >> 6));
+              out += (char)(0x80 | (code & 0x3F));
+            } else {
+              out += (char)(0xE0 | (code >> 12));
+              out += (char)(0x80 | ((code >> 6) & 0x3F));
+              out += (char)(0x80 | (code & 0x3F));
+            }
+            _p += 4;
+            break;
+          }
+          default:
+            return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+        }
+        _p++;
+      }
+      _p++;
+      return true;
+    }
+
+    bool value(JsonNode *&out) {
+      skip();
+      _doc._nodes.emplace_back();
+      JsonNode *node = &_doc._nodes.back();
+      out = node;
+
+      switch (*_p) {
+        case '\0':
+          return fail(DeserializationError::IncompleteInput);
+        case '{':
+          node->type = JsonNode::OBJECT;
+          _p++;
+          skip();
+          if (*_p == '}') {
+            _p++;
+            return true;
+          }
+          while (true) {
+            skip();
+            if (*_p != '"') {
+              return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+            }
+            std::string key;
+            if (!string(key)) {
+              return false;
+            }
+            skip();
+            if (*_p != ':') {
+              return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+            }
+            _p++;
+            JsonNode *member;
+            if (!value(member)) {
+              return false;
+            }
+            node->members.push_back({ key, member });
+            skip();
+            if (*_p == ',') {
+              _p++;
+            } else if (*_p == '}') {
+              _p++;
+              return true;
+            } else {
+              return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+            }
+          }
+        case '[':
+          node->type = JsonNode::ARRAY;
+          _p++;
+          skip();
+          if (*_p == ']') {
+            _p++;
+            return true;
+          }
+          while (true) {
+            JsonNode *element;
+            if (!value(element)) {
+              return false;
+            }
+            node->elements.push_back(element);
+            skip();
+            if (*_p == ',') {
+              _p++;
+            } else if (*_p == ']') {
+              _p++;
+              return true;
+            } else {
+              return fail(*_p ? DeserializationError::InvalidInput : DeserializationError::IncompleteInput);
+            }
+          }
+        case '"':
+          node->type = JsonNode::STRING;
+          return string(node->string);
+        case 't':
+          node->type = JsonNode::BOOLEAN;
+          node->boolean = true;
+          return literal("true");
+        case 'f':
+          node->type = JsonNode::BOOLEAN;
+          return literal("false");
+        case 'n':
+          return literal("null");
+        default: {
+          char *end;
+          node->type = JsonNode::NUMBER;
+          node->number = strtod(_p, &end);
+          if (end == _p) {
+            return fail(DeserializationError::InvalidInput);
+          }
+          _p = end;
+          return true;
+        }
+      }
+    }
+
+  public:
+    JsonParser(DynamicJsonDocument &doc, const char *input) : _doc(doc), _p(input), _error(DeserializationError::Ok) {}
+
+    DeserializationError parse() {
+      _doc._nodes.clear();
+      _doc._root = nullptr;
+      if (_p == nullptr) {
+        return DeserializationError(DeserializationError::InvalidInput);
+      }
+      JsonNode *root;
+      if (!value(root)) {
+        return DeserializationError(_error);
+      }
+      _doc._root = root;
+      return DeserializationError();
+    }
+};
+
+inline DeserializationError deserializeJson(DynamicJsonDocument &doc, const char *input) {
+  return JsonParser(doc, input).parse();
+}
+
+#endif
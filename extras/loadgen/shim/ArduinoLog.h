@@ -0,0 +1,92 @@
+// Host shim for ArduinoLog. Messages at or below the configured level are
+// written to stderr; the ArduinoLog format specifiers are handled generically
+// by streaming each argument in turn.
+#ifndef _Shim_ArduinoLog_H
+#define _Shim_ArduinoLog_H
+
+#include <iostream>
+#include <sstream>
+#include "Arduino.h"
+
+#define LOG_LEVEL_SILENT  0
+#define LOG_LEVEL_FATAL   1
+#define LOG_LEVEL_ERROR   2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_NOTICE  4
+#define LOG_LEVEL_TRACE   5
+#define LOG_LEVEL_VERBOSE 6
+
+class Logging {
+  private:
+    int _level = LOG_LEVEL_ERROR;
+
+    static void format(std::ostringstream &os, const char *fmt) {
+      os << fmt;
+    }
+
+    template <class T>
+    static void put(std::ostringstream &os, T value) {
+      os << value;
+    }
+
+    // promoted to int when passed to the real (variadic) ArduinoLog, not
+    // printed as a character
+    static void put(std::ostringstream &os, uint8_t value) {
+      os << (int)value;
+    }
+
+    template <class T, class... Args>
+    static void format(std::ostringstream &os, const char *fmt, T value, Args... args) {
+      for (; *fmt; fmt++) {
+        if (*fmt == '%' && fmt[1] != '\0') {
+          if (fmt[1] == '%') {
+            os << '%';
+            fmt++;
+            continue;
+          }
+          put(os, value);
+          format(os, fmt + 2, args...);
+          return;
+        }
+        os << *fmt;
+      }
+    }
+
+    template <class T, class... Args>
+    void print(int level, bool newline, T fmt, Args... args) {
+      if (level > _level) {
+        return;
+      }
+      // the "format" may itself be a printable (e.g. Log.verboseln(ip))
+      std::ostringstream fmt_os, os;
+      fmt_os << fmt;
+      format(os, fmt_os.str().c_str(), args...);
+      std::cerr << os.str();
+      if (newline) {
+        std::cerr << std::endl;
+      }
+    }
+
+  public:
+    void begin(int level, Print *output = nullptr) { (void)output; _level = level; }
+    void setLevel(int level) { _level = level; }
+    int getLevel() { return _level; }
+    void setShowLevel(bool show) { (void)show; }
+
+    template <class T, class... Args> void fatal(T fmt, Args... args) { print(LOG_LEVEL_FATAL, false, fmt, args...); }
+    template <class T, class... Args> void fatalln(T fmt, Args... args) { print(LOG_LEVEL_FATAL, true, fmt, args...); }
+    template <class T, class... Args> void error(T fmt, Args... args) { print(LOG_LEVEL_ERROR, false, fmt, args...); }
+    template <class T, class... Args> void errorln(T fmt, Args... args) { print(LOG_LEVEL_ERROR, true, fmt, args...); }
+    template <class T, class... Args> void warning(T fmt, Args... args) { print(LOG_LEVEL_WARNING, false, fmt, args...); }
+    template <class T, class... Args> void warningln(T fmt, Args... args) { print(LOG_LEVEL_WARNING, true, fmt, args...); }
+    template <class T, class... Args> void notice(T fmt, Args... args) { print(LOG_LEVEL_NOTICE, false, fmt, args...); }
+    template <class T, class... Args> void noticeln(T fmt, Args... args) { print(LOG_LEVEL_NOTICE, true, fmt, args...); }
+    template <class T, class... Args> void trace(T fmt, Args... args) { print(LOG_LEVEL_TRACE, false, fmt, args...); }
+    template <class T, class... Args> void traceln(T fmt, Args... args) { print(LOG_LEVEL_TRACE, true, fmt, args...); }
+    template <class T, class... Args> void verbose(T fmt, Args... args) { print(LOG_LEVEL_VERBOSE, false, fmt, args...); }
+    template <class T, class... Args> void verboseln(T fmt, Args... args) { print(LOG_LEVEL_VERBOSE, true, fmt, args...); }
+};
+
+extern Logging Log;
+
+#endif
@@ -0,0 +1,77 @@
+// Host shim for the Ethernet library. EthernetUDP is backed by a real UDP
+// socket on the host so packets can be received by the load generator's sink.
+#ifndef _Shim_Ethernet_H
+#define _Shim_Ethernet_H
+
+#include "Arduino.h"
+#include "Udp.h"
+
+#define MAX_SOCK_NUM 8
+#define UDP_TX_PACKET_MAX_SIZE 1472
+
+enum EthernetLinkStatus {
+  Unknown,
+  LinkON,
+  LinkOFF
+};
+
+enum EthernetHardwareStatus {
+  EthernetNoHardware,
+  EthernetW5100,
+  EthernetW5200,
+  EthernetW5500
+};
+
+class EthernetClass {
+  public:
+    void init(uint8_t cs_pin) { (void)cs_pin; }
+    int begin(uint8_t *mac, unsigned long timeout = 60000, unsigned long response_timeout = 4000) { (void)mac; (void)timeout; (void)response_timeout; return 1; }
+    void begin(uint8_t *mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet) { (void)mac; (void)ip; (void)dns; (void)gateway; (void)subnet; }
+    EthernetLinkStatus linkStatus() { return LinkON; }
+    EthernetHardwareStatus hardwareStatus() { return EthernetW5500; }
+    int maintain() { return 0; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern EthernetClass Ethernet;
+
+class EthernetUDP : public UDP {
+  private:
+    int _fd = -1;
+    uint16_t _port = 0;
+    IPAddress _remote_ip;
+    uint16_t _remote_port = 0;
+    uint8_t _tx[UDP_TX_PACKET_MAX_SIZE];
+    size_t _tx_length = 0;
+    uint8_t _rx[UDP_TX_PACKET_MAX_SIZE];
+    size_t _rx_length = 0;
+    size_t _rx_offset = 0;
+
+  protected:
+    uint8_t sockindex = MAX_SOCK_NUM;
+    uint16_t _remaining = 0;
+
+  public:
+    virtual ~EthernetUDP() { stop(); }
+
+    uint8_t begin(uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+    int parsePacket();
+    int available();
+    int read();
+    int read(uint8_t *buffer, size_t size);
+    int peek();
+    void flush() {}
+
+    IPAddress remoteIP() { return _remote_ip; }
+    uint16_t remotePort() { return _remote_port; }
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _Shim_IPAddress_H
+#define _Shim_IPAddress_H
+
+#include <stdint.h>
+#include <ostream>
+
+class IPAddress {
+  private:
+    uint8_t _address[4];
+  public:
+    IPAddress() : _address{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address{a, b, c, d} {}
+    IPAddress(const uint8_t *address) { memcpy(_address, address, 4); }
+
+    uint8_t operator[](int index) const { return _address[index]; }
+    uint8_t &operator[](int index) { return _address[index]; }
+    const uint8_t *raw_address() const { return _address; }
+    bool operator==(const IPAddress &rhs) const { return memcmp(_address, rhs._address, 4) == 0; }
+    bool operator!=(const IPAddress &rhs) const { return !(*this == rhs); }
+
+    friend std::ostream &operator<<(std::ostream &os, const IPAddress &ip) {
+      return os << (int)ip[0] << "." << (int)ip[1] << "." << (int)ip[2] << "." << (int)ip[3];
+    }
+};
+
+#endif
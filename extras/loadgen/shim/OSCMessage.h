@@ -0,0 +1,159 @@
+// Host shim for the CNMAT OSC library (messages with int/float/string
+// arguments, encoded and decoded exactly as OSC 1.0 on the wire)
+#ifndef _Shim_OSCMessage_H
+#define _Shim_OSCMessage_H
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+class OSCMessage {
+  private:
+    std::string _address;
+    std::string _types;
+    std::vector<uint8_t> _data;
+    std::vector<uint8_t> _incoming;
+    std::vector<std::string> _strings;
+    bool _error = false;
+
+    static void pad(std::vector<uint8_t> &out) {
+      while (out.size() % 4) {
+        out.push_back(0);
+      }
+    }
+
+    static void put_string(std::vector<uint8_t> &out, const std::string &s) {
+      out.insert(out.end(), s.begin(), s.end());
+      out.push_back(0);
+      pad(out);
+    }
+
+    static void put_int(std::vector<uint8_t> &out, uint32_t v) {
+      out.push_back(v >> 24);
+      out.push_back(v >> 16);
+      out.push_back(v >> 8);
+      out.push_back(v);
+    }
+
+    static bool get_string(const std::vector<uint8_t> &in, size_t &offset, std::string &s) {
+      size_t end = offset;
+      while (end < in.size() && in[end] != 0) {
+        end++;
+      }
+      if (end >= in.size()) {
+        return false;
+      }
+      s.assign(in.begin() + offset, in.begin() + end);
+      offset = (end + 4) & ~(size_t)3;
+      return offset <= in.size();
+    }
+
+    // decodes everything filled so far
+    void decode() {
+      size_t offset = 0;
+      std::string types;
+      _strings.clear();
+      _error = !get_string(_incoming, offset, _address) || !get_string(_incoming, offset, types) || types.empty() || types[0] != ',';
+      if (_error) {
+        return;
+      }
+      _types = types.substr(1);
+      for (char type : _types) {
+        std::string s;
+        if (type == 's') {
+          _error |= !get_string(_incoming, offset, s);
+        } else if (type == 'i' || type == 'f') {
+          offset += 4;
+          _error |= offset > _incoming.size();
+        } else {
+          _error = true;
+        }
+        _strings.push_back(s);
+      }
+    }
+
+  public:
+    OSCMessage() {}
+    OSCMessage(const char *address) : _address(address ? address : "") {}
+
+    void fill(uint8_t c) {
+      _incoming.push_back(c);
+      decode();
+    }
+
+    void fill(const uint8_t *buffer, int length) {
+      _incoming.insert(_incoming.end(), buffer, buffer + length);
+      decode();
+    }
+
+    bool hasError() const {
+      return _error;
+    }
+
+    bool fullMatch(const char *pattern, int offset = 0) const {
+      return _address.compare(offset, std::string::npos, pattern) == 0;
+    }
+
+    bool isString(int position) const {
+      return position < (int)_types.size() && _types[position] == 's';
+    }
+
+    int getDataLength(int position) const {
+      return isString(position) ? _strings[position].size() + 1 : 0;
+    }
+
+    int getString(int position, char *buffer, int length) const {
+      if (!isString(position) || length <= 0) {
+        return 0;
+      }
+      int size = std::min((int)_strings[position].size(), length - 1);
+      memcpy(buffer, _strings[position].data(), size);
+      buffer[size] = 0;
+      return size;
+    }
+
+    OSCMessage &add(int32_t value) {
+      _types += 'i';
+      put_int(_data, (uint32_t)value);
+      return *this;
+    }
+
+    OSCMessage &add(float value) {
+      uint32_t v;
+      memcpy(&v, &value, sizeof(v));
+      _types += 'f';
+      put_int(_data, v);
+      return *this;
+    }
+
+    OSCMessage &add(const char *value) {
+      _types += 's';
+      put_string(_data, value);
+      return *this;
+    }
+
+    std::vector<uint8_t> encode() const {
+      std::vector<uint8_t> out;
+      put_string(out, _address);
+      put_string(out, "," + _types);
+      out.insert(out.end(), _data.begin(), _data.end());
+      return out;
+    }
+
+    size_t bytes() const {
+      return encode().size();
+    }
+
+    OSCMessage &send(Print &p) {
+      std::vector<uint8_t> out = encode();
+      p.write(out.data(), out.size());
+      return *this;
+    }
+
+    void empty() {
+      _types.clear();
+      _data.clear();
+    }
+};
+
+#endif
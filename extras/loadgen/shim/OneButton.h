@@ -0,0 +1,73 @@
+// Host shim for OneButton, covering the debounce/press-start behaviour the
+// sketch relies on (every press fires the long press start callback once
+// pressMs has elapsed).
+#ifndef _Shim_OneButton_H
+#define _Shim_OneButton_H
+
+#include "Arduino.h"
+
+extern "C" {
+typedef void (*parameterizedCallbackFunction)(void *);
+}
+
+class OneButton {
+  private:
+    int _pin = -1;
+    bool _active_low = true;
+    unsigned int _debounce_ms = 50;
+    unsigned int _press_ms = 800;
+    parameterizedCallbackFunction _long_press_start = nullptr;
+    void *_long_press_start_param = nullptr;
+
+    bool _last_level = false;
+    bool _debounced = false;
+    bool _fired = false;
+    unsigned long _level_time = 0;
+    unsigned long _press_time = 0;
+
+  public:
+    OneButton() {}
+    OneButton(const int pin, const bool active_low = true, const bool pullup_active = true) : _pin(pin), _active_low(active_low) {
+      pinMode(pin, pullup_active ? INPUT_PULLUP : INPUT);
+    }
+
+    void setDebounceMs(const unsigned int ms) { _debounce_ms = ms; }
+    void setClickMs(const unsigned int ms) { (void)ms; }
+    void setPressMs(const unsigned int ms) { _press_ms = ms; }
+    void setIdleMs(const unsigned int ms) { (void)ms; }
+    void attachLongPressStart(parameterizedCallbackFunction function, void *parameter) {
+      _long_press_start = function;
+      _long_press_start_param = parameter;
+    }
+
+    void tick() {
+      if (_pin >= 0) {
+        tick(digitalRead(_pin) == (_active_low ? LOW : HIGH));
+      }
+    }
+
+    void tick(bool active) {
+      unsigned long now = millis();
+
+      // debounce the level
+      if (active != _last_level) {
+        _last_level = active;
+        _level_time = now;
+      }
+      if (active != _debounced && (now - _level_time) >= _debounce_ms) {
+        _debounced = active;
+        _press_time = now;
+        _fired = false;
+      }
+
+      // press start
+      if (_debounced && !_fired && (now - _press_time) >= _press_ms) {
+        _fired = true;
+        if (_long_press_start) {
+          _long_press_start(_long_press_start_param);
+        }
+      }
+    }
+};
+
+#endif
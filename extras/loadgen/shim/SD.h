@@ -0,0 +1,57 @@
+// Host shim for the SD library's low level classes. The card is a host
+// directory (set with sim_sd_root()), and a file's directory entry gives its
+// size and modification time in FAT form, as on the card.
+#ifndef _Shim_SD_H
+#define _Shim_SD_H
+
+#include <string>
+#include "Arduino.h"
+
+#define SPI_HALF_SPEED 1
+
+// the host directory standing in for the card's root directory
+void sim_sd_root(const char *path);
+
+typedef struct {
+  uint32_t fileSize;
+  uint16_t lastWriteDate;
+  uint16_t lastWriteTime;
+} dir_t;
+
+class Sd2Card {
+  public:
+    bool init(uint8_t speed, uint8_t cs_pin) { (void)speed; (void)cs_pin; return true; }
+};
+
+class SdVolume {
+  public:
+    bool init(Sd2Card &card) { (void)card; return true; }
+};
+
+class SdFile {
+  private:
+    std::string _path;
+    FILE *_file = nullptr;
+
+  public:
+    bool openRoot(SdVolume &volume);
+    bool open(SdFile &dir, const char *name);
+    bool dirEntry(dir_t *entry);
+    int read(void *buffer, uint16_t size);
+    uint32_t fileSize();
+    void close();
+};
+
+class SDFile {
+  private:
+    SdFile _file;
+
+  public:
+    SDFile() {}
+    SDFile(SdFile file, const char *name) : _file(file) { (void)name; }
+    uint32_t size() { return _file.fileSize(); }
+    int read(void *buffer, uint16_t size) { return _file.read(buffer, size); }
+    void close() { _file.close(); }
+};
+
+#endif
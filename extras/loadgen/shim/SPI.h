@@ -0,0 +1,28 @@
+// Host shim for SPI. Transfers read back an idle (pulled up) bus.
+#ifndef _Shim_SPI_H
+#define _Shim_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+class SPISettings {
+  public:
+    SPISettings() {}
+    SPISettings(uint32_t clock, uint8_t bit_order, uint8_t data_mode) { (void)clock; (void)bit_order; (void)data_mode; }
+};
+
+class SPIClass {
+  public:
+    void begin() {}
+    void beginTransaction(SPISettings settings) { (void)settings; }
+    uint8_t transfer(uint8_t data) { (void)data; return 0xFF; }
+    void endTransaction() {}
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,20 @@
+// Host shim for the core's UDP interface (the parts the sketch uses)
+#ifndef _Shim_Udp_H
+#define _Shim_Udp_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+class UDP : public Stream {
+  public:
+    virtual uint8_t begin(uint16_t port) = 0;
+    virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+    virtual int endPacket() = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual int parsePacket() = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    using Print::write;
+    using Stream::read;
+};
+
+#endif
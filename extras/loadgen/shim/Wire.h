@@ -0,0 +1,24 @@
+// Host shim for Wire (I2C). Reads return an idle (pulled up) port.
+#ifndef _Shim_Wire_H
+#define _Shim_Wire_H
+
+#include "Arduino.h"
+
+class TwoWire {
+  private:
+    uint8_t _available = 0;
+
+  public:
+    void begin() {}
+    void setClock(uint32_t clock) { (void)clock; }
+    void beginTransmission(uint8_t address) { (void)address; }
+    size_t write(uint8_t data) { (void)data; return 1; }
+    uint8_t endTransmission(bool stop = true) { (void)stop; return 0; }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) { (void)address; _available = quantity; return quantity; }
+    int available() { return _available; }
+    int read() { if (_available == 0) return -1; _available--; return 0xFF; }
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,588 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "Arduino.h"
+#include "ArduinoLog.h"
+#include "Ethernet.h"
+#include "SD.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "utility/w5100.h"
+
+Logging Log;
+SPIClass SPI;
+TwoWire Wire;
+EthernetClass Ethernet;
+
+// time
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// set while a handler raised with sim_raise_interrupt_at() runs (only on the
+// thread that raised it)
+static thread_local bool interrupt_time_set = false;
+static thread_local unsigned long interrupt_time_us = 0;
+
+unsigned long micros() {
+  if (interrupt_time_set) {
+    return interrupt_time_us;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// busy waits like the AVR core does, as sleeping for a few us takes far longer
+void delayMicroseconds(unsigned int us) {
+  unsigned long start = micros();
+  while (micros() - start < us) {
+  }
+}
+
+// pins (inputs idle high, as if pulled up)
+static volatile uint8_t pin_values[SIM_PIN_COUNT];
+static volatile uint8_t pin_modes[SIM_PIN_COUNT];
+static bool pins_initialised = false;
+
+static void init_pins() {
+  if (!pins_initialised) {
+    memset((void *)pin_values, HIGH, sizeof(pin_values));
+    pins_initialised = true;
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  init_pins();
+  pin_modes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  init_pins();
+  pin_values[pin] = value ? HIGH : LOW;
+}
+
+// the closed switches on each pin, by the pin at their other end
+static std::vector<uint8_t> switches[SIM_PIN_COUNT];
+
+int digitalRead(uint8_t pin) {
+  init_pins();
+  if (pin_modes[pin] != OUTPUT) {
+    for (uint8_t other : switches[pin]) {
+      if (pin_modes[other] == OUTPUT && pin_values[other] == LOW) {
+        return LOW;
+      }
+    }
+  }
+  return pin_values[pin];
+}
+
+void analogWrite(uint8_t pin, int value) {
+  init_pins();
+  pin_values[pin] = value ? HIGH : LOW;
+}
+
+void sim_set_pin(uint8_t pin, uint8_t value) {
+  init_pins();
+  pin_values[pin] = value;
+}
+
+uint8_t sim_get_pin(uint8_t pin) {
+  init_pins();
+  return pin_values[pin];
+}
+
+void sim_set_switch(uint8_t a, uint8_t b, bool closed) {
+  switches[a].erase(std::remove(switches[a].begin(), switches[a].end(), b), switches[a].end());
+  switches[b].erase(std::remove(switches[b].begin(), switches[b].end(), a), switches[b].end());
+  if (closed) {
+    switches[a].push_back(b);
+    switches[b].push_back(a);
+  }
+}
+
+// interrupts (the load generator raises them from the loop thread, so the
+// handlers run synchronously like a real ISR between two instructions)
+static void (*interrupt_handlers[SIM_PIN_COUNT])();
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  (void)mode;
+  interrupt_handlers[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  interrupt_handlers[interrupt] = nullptr;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+void sim_raise_interrupt(uint8_t interrupt) {
+  if (interrupt_handlers[interrupt]) {
+    interrupt_handlers[interrupt]();
+  }
+}
+
+void sim_raise_interrupt_at(uint8_t interrupt, unsigned long us) {
+  interrupt_time_us = us;
+  interrupt_time_set = true;
+  sim_raise_interrupt(interrupt);
+  interrupt_time_set = false;
+}
+
+// SD card
+static std::string sd_root = ".";
+
+void sim_sd_root(const char *path) {
+  sd_root = path;
+}
+
+bool SdFile::openRoot(SdVolume &volume) {
+  (void)volume;
+  _path = sd_root;
+  return true;
+}
+
+bool SdFile::open(SdFile &dir, const char *name) {
+  _path = dir._path + "/" + name;
+  _file = fopen(_path.c_str(), "rb");
+  return _file != nullptr;
+}
+
+bool SdFile::dirEntry(dir_t *entry) {
+  struct stat info;
+  if (_file == nullptr || fstat(fileno(_file), &info) != 0) {
+    return false;
+  }
+
+  // FAT dates count from 1980, and times are to 2 seconds
+  struct tm local;
+  localtime_r(&info.st_mtime, &local);
+  entry->fileSize = info.st_size;
+  entry->lastWriteDate = ((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday;
+  entry->lastWriteTime = (local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2);
+  return true;
+}
+
+int SdFile::read(void *buffer, uint16_t size) {
+  return _file ? fread(buffer, 1, size, _file) : -1;
+}
+
+uint32_t SdFile::fileSize() {
+  struct stat info;
+  return (_file && fstat(fileno(_file), &info) == 0) ? info.st_size : 0;
+}
+
+void SdFile::close() {
+  if (_file) {
+    fclose(_file);
+    _file = nullptr;
+  }
+}
+
+// EthernetUDP
+uint8_t EthernetUDP::begin(uint16_t port) {
+  // like the library, any socket the chip reports closed is free
+  uint8_t s;
+  for (s = 0; s < MAX_SOCK_NUM && !W5100.sim_closed(s); s++);
+  if (s == MAX_SOCK_NUM) {
+    return 0;
+  }
+
+  _fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_fd < 0) {
+    return 0;
+  }
+  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+
+  int reuse = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(_fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(_fd);
+    _fd = -1;
+    return 0;
+  }
+
+  _port = port;
+  sockindex = s;
+  W5100.sim_attach(sockindex, _fd);
+  return 1;
+}
+
+void EthernetUDP::stop() {
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  if (sockindex < MAX_SOCK_NUM) {
+    W5100.sim_attach(sockindex, -1);
+  }
+  sockindex = MAX_SOCK_NUM;
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port) {
+  _remote_ip = ip;
+  _remote_port = port;
+  _tx_length = 0;
+  return _fd >= 0;
+}
+
+int EthernetUDP::endPacket() {
+  if (_fd < 0) {
+    return 0;
+  }
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  memcpy(&addr.sin_addr.s_addr, _remote_ip.raw_address(), 4);
+  addr.sin_port = htons(_remote_port);
+  ssize_t sent = sendto(_fd, _tx, _tx_length, 0, (sockaddr *)&addr, sizeof(addr));
+  _tx_length = 0;
+  return sent >= 0;
+}
+
+size_t EthernetUDP::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t EthernetUDP::write(const uint8_t *buffer, size_t size) {
+  size = min(size, sizeof(_tx) - _tx_length);
+  memcpy(_tx + _tx_length, buffer, size);
+  _tx_length += size;
+  return size;
+}
+
+int EthernetUDP::parsePacket() {
+  if (_fd < 0) {
+    return 0;
+  }
+
+  sockaddr_in addr = {};
+  socklen_t length = sizeof(addr);
+  ssize_t received = recvfrom(_fd, _rx, sizeof(_rx), 0, (sockaddr *)&addr, &length);
+  if (received <= 0) {
+    _remaining = 0;
+    return 0;
+  }
+
+  _remote_ip = IPAddress((const uint8_t *)&addr.sin_addr.s_addr);
+  _remote_port = ntohs(addr.sin_port);
+  _rx_length = received;
+  _rx_offset = 0;
+  _remaining = received;
+  return received;
+}
+
+// as on the W5x00, this is the unread part of the last parsed packet
+int EthernetUDP::available() {
+  return _remaining;
+}
+
+int EthernetUDP::read() {
+  if (_remaining == 0) {
+    return -1;
+  }
+  _remaining--;
+  return _rx[_rx_offset++];
+}
+
+int EthernetUDP::read(uint8_t *buffer, size_t size) {
+  size = min(size, (size_t)_remaining);
+  memcpy(buffer, _rx + _rx_offset, size);
+  _rx_offset += size;
+  _remaining -= size;
+  return size;
+}
+
+int EthernetUDP::peek() {
+  return _remaining ? _rx[_rx_offset] : -1;
+}
+
+// W5x00 registers
+W5100Class W5100;
+
+struct SimSocket {
+  int fd = -1;
+  int tcp_fd = -1;
+  uint8_t mr = SnMR::CLOSE;
+  uint8_t sr = SnSR::CLOSED;
+  uint16_t port = 0;
+  uint8_t dipr[4] = { 0, 0, 0, 0 };
+  uint16_t dport = 0;
+  uint16_t tx_rd = 0;
+  uint16_t tx_wr = 0;
+  uint8_t ir = 0;
+};
+
+static uint8_t chip_memory[0x10000];
+static SimSocket chip_sockets[MAX_SOCK_NUM];
+static unsigned long chip_accesses = 0;
+static unsigned long chip_mark = 0;
+static unsigned long chip_sends = 0;
+static unsigned long chip_send_accesses = 0;
+
+// the accesses leading up to a send (each send is counted from the mark or
+// the send before, whichever is later)
+static void count_send() {
+  chip_sends++;
+  chip_send_accesses += chip_accesses - chip_mark;
+  chip_mark = chip_accesses;
+}
+
+uint16_t W5100Class::write(uint16_t address, const uint8_t *buffer, uint16_t length) {
+  chip_accesses++;
+  memcpy(chip_memory + address, buffer, min((size_t)length, sizeof(chip_memory) - address));
+  return length;
+}
+
+uint16_t W5100Class::read(uint16_t address, uint8_t *buffer, uint16_t length) {
+  chip_accesses++;
+  memcpy(buffer, chip_memory + address, min((size_t)length, sizeof(chip_memory) - address));
+  return length;
+}
+
+uint16_t W5100Class::readSnTX_WR(uint8_t s) {
+  chip_accesses++;
+  return chip_sockets[s].tx_wr;
+}
+
+void W5100Class::writeSnTX_WR(uint8_t s, uint16_t value) {
+  chip_accesses++;
+  chip_sockets[s].tx_wr = value;
+}
+
+uint16_t W5100Class::readSnTX_RD(uint8_t s) {
+  chip_accesses++;
+  return chip_sockets[s].tx_rd;
+}
+
+uint16_t W5100Class::readSnTX_FSR(uint8_t s) {
+  // sends are immediate, so the buffer is only waiting on unsent writes and
+  // (over TCP) whatever the host connection hasn't had ACKed yet
+  SimSocket &socket = chip_sockets[s];
+  chip_accesses++;
+  int unacked = 0;
+  if (socket.tcp_fd >= 0 && ioctl(socket.tcp_fd, SIOCOUTQ, &unacked) < 0) {
+    unacked = 0;
+  }
+  return SSIZE - (uint16_t)(socket.tx_wr - socket.tx_rd) - min((uint16_t)unacked, SSIZE);
+}
+
+void W5100Class::writeSnMR(uint8_t s, uint8_t value) {
+  chip_accesses++;
+  chip_sockets[s].mr = value;
+}
+
+void W5100Class::writeSnPORT(uint8_t s, uint16_t port) {
+  chip_accesses++;
+  chip_sockets[s].port = port;
+}
+
+static void close_tcp(SimSocket &socket) {
+  if (socket.tcp_fd >= 0) {
+    close(socket.tcp_fd);
+    socket.tcp_fd = -1;
+  }
+}
+
+uint8_t W5100Class::readSnSR(uint8_t s) {
+  SimSocket &socket = chip_sockets[s];
+  chip_accesses++;
+
+  if (socket.sr == SnSR::SYNSENT) {
+    // the host connect has finished once the socket is writable
+    pollfd fd = { socket.tcp_fd, POLLOUT, 0 };
+    if (poll(&fd, 1, 0) == 1) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(socket.tcp_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+      if (error == 0) {
+        socket.sr = SnSR::ESTABLISHED;
+      } else {
+        close_tcp(socket);
+        socket.sr = SnSR::CLOSED;
+        socket.ir |= SnIR::TIMEOUT;
+      }
+    }
+  } else if (socket.sr == SnSR::ESTABLISHED) {
+    // the other end closing shows up as a zero length read (anything it sends
+    // is thrown away, the sketch never reads it)
+    uint8_t buffer[256];
+    ssize_t received = recv(socket.tcp_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0) {
+      socket.sr = SnSR::CLOSE_WAIT;
+      socket.ir |= SnIR::DISCON;
+    } else if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      close_tcp(socket);
+      socket.sr = SnSR::CLOSED;
+      socket.ir |= SnIR::DISCON;
+    }
+  }
+  return socket.sr;
+}
+
+void W5100Class::writeSnDIPR(uint8_t s, const uint8_t *address) {
+  chip_accesses++;
+  memcpy(chip_sockets[s].dipr, address, 4);
+}
+
+void W5100Class::writeSnDPORT(uint8_t s, uint16_t port) {
+  chip_accesses++;
+  chip_sockets[s].dport = port;
+}
+
+uint8_t W5100Class::readSnIR(uint8_t s) {
+  chip_accesses++;
+  return chip_sockets[s].ir;
+}
+
+void W5100Class::writeSnIR(uint8_t s, uint8_t value) {
+  // writing a one clears the interrupt bit
+  chip_accesses++;
+  chip_sockets[s].ir &= ~value;
+}
+
+static void connect_tcp(SimSocket &socket) {
+  socket.tcp_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (socket.tcp_fd < 0) {
+    socket.sr = SnSR::CLOSED;
+    return;
+  }
+  fcntl(socket.tcp_fd, F_SETFL, fcntl(socket.tcp_fd, F_GETFL) | O_NONBLOCK);
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  memcpy(&addr.sin_addr.s_addr, socket.dipr, 4);
+  addr.sin_port = htons(socket.dport);
+  if (connect(socket.tcp_fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+    socket.sr = SnSR::ESTABLISHED;
+    socket.ir |= SnIR::CON;
+  } else if (errno == EINPROGRESS) {
+    socket.sr = SnSR::SYNSENT;
+  } else {
+    close_tcp(socket);
+    socket.sr = SnSR::CLOSED;
+    socket.ir |= SnIR::TIMEOUT;
+  }
+}
+
+void W5100Class::execCmdSn(uint8_t s, SockCMD command) {
+  SimSocket &socket = chip_sockets[s];
+  chip_accesses++;
+
+  if (socket.mr == SnMR::TCP) {
+    switch (command) {
+      case Sock_OPEN:
+        close_tcp(socket);
+        socket.sr = SnSR::INIT;
+        socket.tx_rd = 0;
+        socket.tx_wr = 0;
+        break;
+      case Sock_CONNECT:
+        if (socket.sr == SnSR::INIT) {
+          connect_tcp(socket);
+        }
+        break;
+      case Sock_DISCON:
+      case Sock_CLOSE:
+        close_tcp(socket);
+        socket.sr = SnSR::CLOSED;
+        break;
+      case Sock_SEND: {
+        count_send();
+        uint8_t data[SSIZE];
+        uint16_t length = socket.tx_wr - socket.tx_rd;
+        for (uint16_t i = 0; i < length; i++) {
+          data[i] = chip_memory[SBASE(s) + ((socket.tx_rd + i) & SMASK)];
+        }
+        socket.tx_rd = socket.tx_wr;
+        if (socket.sr == SnSR::ESTABLISHED && send(socket.tcp_fd, data, length, MSG_NOSIGNAL) == length) {
+          socket.ir |= SnIR::SEND_OK;
+        } else {
+          close_tcp(socket);
+          socket.sr = SnSR::CLOSED;
+          socket.ir |= SnIR::TIMEOUT;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+    return;
+  }
+
+  if (command == Sock_CLOSE) {
+    socket.mr = SnMR::CLOSE;
+    socket.sr = SnSR::CLOSED;
+  } else if (command == Sock_SEND) {
+    // transmit everything between TX_RD and TX_WR
+    count_send();
+    uint8_t packet[SSIZE];
+    uint16_t length = socket.tx_wr - socket.tx_rd;
+    for (uint16_t i = 0; i < length; i++) {
+      packet[i] = chip_memory[SBASE(s) + ((socket.tx_rd + i) & SMASK)];
+    }
+    socket.tx_rd = socket.tx_wr;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    memcpy(&addr.sin_addr.s_addr, socket.dipr, 4);
+    addr.sin_port = htons(socket.dport);
+    if (socket.fd >= 0 && sendto(socket.fd, packet, length, 0, (sockaddr *)&addr, sizeof(addr)) >= 0) {
+      socket.ir |= SnIR::SEND_OK;
+    } else {
+      socket.ir |= SnIR::TIMEOUT;
+    }
+  }
+}
+
+void W5100Class::sim_attach(uint8_t s, int fd) {
+  close_tcp(chip_sockets[s]);
+  chip_sockets[s] = SimSocket();
+  chip_sockets[s].fd = fd;
+  if (fd >= 0) {
+    chip_sockets[s].mr = SnMR::UDP;
+    chip_sockets[s].sr = SnSR::UDP;
+  }
+}
+
+bool W5100Class::sim_closed(uint8_t s) {
+  return chip_sockets[s].sr == SnSR::CLOSED;
+}
+
+unsigned long W5100Class::sim_accesses() {
+  return chip_accesses;
+}
+
+void W5100Class::sim_mark() {
+  chip_mark = chip_accesses;
+}
+
+unsigned long W5100Class::sim_sends() {
+  return chip_sends;
+}
+
+unsigned long W5100Class::sim_send_accesses() {
+  return chip_send_accesses;
+}
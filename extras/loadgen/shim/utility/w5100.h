@@ -0,0 +1,95 @@
+// Host shim for the W5x00 register interface in the Ethernet library. Each
+// socket has emulated TX memory and destination registers, and the SEND
+// command transmits through the host socket behind the matching EthernetUDP
+// (or, for a socket reopened in TCP mode, a host TCP connection).
+#ifndef _Shim_W5100_H
+#define _Shim_W5100_H
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Ethernet.h"
+
+#define SPI_ETHERNET_SETTINGS SPISettings(14000000, MSBFIRST, SPI_MODE0)
+
+class SnIR {
+  public:
+    static const uint8_t SEND_OK = 0x10;
+    static const uint8_t TIMEOUT = 0x08;
+    static const uint8_t RECV    = 0x04;
+    static const uint8_t DISCON  = 0x02;
+    static const uint8_t CON     = 0x01;
+};
+
+class SnMR {
+  public:
+    static const uint8_t CLOSE = 0x00;
+    static const uint8_t TCP   = 0x21;
+    static const uint8_t UDP   = 0x02;
+};
+
+class SnSR {
+  public:
+    static const uint8_t CLOSED      = 0x00;
+    static const uint8_t INIT        = 0x13;
+    static const uint8_t LISTEN      = 0x14;
+    static const uint8_t SYNSENT     = 0x15;
+    static const uint8_t SYNRECV     = 0x16;
+    static const uint8_t ESTABLISHED = 0x17;
+    static const uint8_t FIN_WAIT    = 0x18;
+    static const uint8_t CLOSING     = 0x1A;
+    static const uint8_t TIME_WAIT   = 0x1B;
+    static const uint8_t CLOSE_WAIT  = 0x1C;
+    static const uint8_t LAST_ACK    = 0x1D;
+    static const uint8_t UDP         = 0x22;
+};
+
+enum SockCMD {
+  Sock_OPEN      = 0x01,
+  Sock_LISTEN    = 0x02,
+  Sock_CONNECT   = 0x04,
+  Sock_DISCON    = 0x08,
+  Sock_CLOSE     = 0x10,
+  Sock_SEND      = 0x20,
+  Sock_SEND_MAC  = 0x21,
+  Sock_SEND_KEEP = 0x22,
+  Sock_RECV      = 0x40
+};
+
+class W5100Class {
+  public:
+    static const uint16_t SSIZE = 2048;
+    static const uint16_t SMASK = 0x07FF;
+
+    static uint16_t SBASE(uint8_t socknum) { return socknum * SSIZE + 0x4000; }
+    static bool hasOffsetAddressMapping() { return false; }
+
+    static uint16_t write(uint16_t address, const uint8_t *buffer, uint16_t length);
+    static uint16_t read(uint16_t address, uint8_t *buffer, uint16_t length);
+
+    static uint16_t readSnTX_WR(uint8_t s);
+    static void writeSnTX_WR(uint8_t s, uint16_t value);
+    static uint16_t readSnTX_RD(uint8_t s);
+    static uint16_t readSnTX_FSR(uint8_t s);
+    static void writeSnMR(uint8_t s, uint8_t value);
+    static void writeSnPORT(uint8_t s, uint16_t port);
+    static uint8_t readSnSR(uint8_t s);
+    static void writeSnDIPR(uint8_t s, const uint8_t *address);
+    static void writeSnDPORT(uint8_t s, uint16_t port);
+    static uint8_t readSnIR(uint8_t s);
+    static void writeSnIR(uint8_t s, uint8_t value);
+    static void execCmdSn(uint8_t s, SockCMD command);
+
+    // simulation hooks
+    static void sim_attach(uint8_t s, int fd);
+    static bool sim_closed(uint8_t s);
+    static unsigned long sim_accesses();
+    // accesses made from the last sim_mark() (the start of a loop) up to and
+    // including each SEND command, totalled over all sends
+    static void sim_mark();
+    static unsigned long sim_sends();
+    static unsigned long sim_send_accesses();
+};
+
+extern W5100Class W5100;
+
+#endif
@@ -0,0 +1,302 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "sink.h"
+
+// SLIP framing, as in TargetStream.h
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+OSCSink::OSCSink() : _fd(-1), _tcp(false), _running(false), _drop(false), _accepted(0) {
+}
+
+OSCSink::~OSCSink() {
+  stop();
+}
+
+bool OSCSink::begin(unsigned short port, bool tcp) {
+  _tcp = tcp;
+  _fd = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (_fd < 0) {
+    return false;
+  }
+
+  // large receive buffer so bursts are not dropped by the host itself
+  int size = 4 * 1024 * 1024;
+  setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  int reuse = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // wake up periodically so stop() is noticed
+  timeval timeout = { 0, 100000 };
+  setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || (tcp && listen(_fd, 4) < 0)) {
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+
+  _running = true;
+  _thread = tcp ? std::thread(&OSCSink::run_tcp, this) : std::thread(&OSCSink::run, this);
+  return true;
+}
+
+void OSCSink::disconnect() {
+  _drop = true;
+}
+
+unsigned long OSCSink::accepted() {
+  return _accepted;
+}
+
+void OSCSink::stop() {
+  if (_running) {
+    _running = false;
+    _thread.join();
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+void OSCSink::receive(const unsigned char *data, size_t length) {
+  // timestamp on the same clock as the simulated sketch
+  SinkPacket packet;
+  packet.time_us = micros();
+  packet.valid = validate(data, length, packet.address);
+  packet.timetag = 0;
+  if (packet.valid && memcmp(data, "#bundle", 8) == 0) {
+    for (int i = 8; i < 16; i++) {
+      packet.timetag = (packet.timetag << 8) | data[i];
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  _packets.push_back(packet);
+}
+
+void OSCSink::run() {
+  unsigned char buffer[2048];
+
+  while (_running) {
+    ssize_t length = recv(_fd, buffer, sizeof(buffer), 0);
+    if (length < 0) {
+      continue;
+    }
+    receive(buffer, length);
+  }
+}
+
+// reads what has arrived on a connection, returning false once it has closed
+bool OSCSink::read(SinkConnection &connection) {
+  unsigned char buffer[2048];
+  ssize_t length = recv(connection.fd, buffer, sizeof(buffer), 0);
+  if (length <= 0) {
+    return false;
+  }
+
+  // each END finishes a frame, with the empty ones between back to back ENDs
+  // skipped - a bad escape is passed on and so fails validation
+  for (ssize_t i = 0; i < length; i++) {
+    unsigned char c = buffer[i];
+    if (connection.escaped) {
+      connection.frame.push_back(c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c);
+      connection.escaped = false;
+    } else if (c == SLIP_END) {
+      if (!connection.frame.empty()) {
+        receive(connection.frame.data(), connection.frame.size());
+        connection.frame.clear();
+      }
+    } else if (c == SLIP_ESC) {
+      connection.escaped = true;
+    } else {
+      connection.frame.push_back(c);
+    }
+  }
+  return true;
+}
+
+void OSCSink::run_tcp() {
+  std::vector<SinkConnection> connections;
+
+  while (_running) {
+    if (_drop) {
+      for (SinkConnection &connection : connections) {
+        close(connection.fd);
+      }
+      connections.clear();
+      _drop = false;
+    }
+
+    std::vector<pollfd> fds;
+    fds.push_back({ _fd, POLLIN, 0 });
+    for (SinkConnection &connection : connections) {
+      fds.push_back({ connection.fd, POLLIN, 0 });
+    }
+    if (poll(fds.data(), fds.size(), 100) <= 0) {
+      continue;
+    }
+
+    for (size_t i = connections.size(); i > 0; i--) {
+      if (fds[i].revents && !read(connections[i - 1])) {
+        close(connections[i - 1].fd);
+        connections.erase(connections.begin() + (i - 1));
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(_fd, nullptr, nullptr);
+      if (fd >= 0) {
+        connections.push_back({ fd, {}, false });
+        _accepted++;
+      }
+    }
+  }
+
+  for (SinkConnection &connection : connections) {
+    close(connection.fd);
+  }
+}
+
+std::vector<SinkPacket> OSCSink::packets() {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _packets;
+}
+
+size_t OSCSink::count() {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _packets.size();
+}
+
+// length of a padded OSC string starting at data, or 0 if it is malformed
+static size_t osc_string_length(const unsigned char *data, size_t length) {
+  const unsigned char *end = (const unsigned char *)memchr(data, 0, length);
+  if (end == nullptr) {
+    return 0;
+  }
+  size_t padded = ((end - data) / 4 + 1) * 4;
+  if (padded > length) {
+    return 0;
+  }
+  for (size_t i = end - data; i < padded; i++) {
+    if (data[i] != 0) {
+      return 0;
+    }
+  }
+  return padded;
+}
+
+static uint32_t osc_int(const unsigned char *data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+bool OSCSink::validate(const unsigned char *data, size_t length, std::string &address) {
+  if (length == 0 || length % 4 != 0) {
+    return false;
+  }
+
+  // bundle: "#bundle", timetag, then size prefixed elements
+  if (length >= 16 && memcmp(data, "#bundle", 8) == 0) {
+    size_t offset = 16;
+    bool first = true;
+    while (offset < length) {
+      if (offset + 4 > length) {
+        return false;
+      }
+      size_t size = osc_int(data + offset);
+      offset += 4;
+      if (size == 0 || offset + size > length) {
+        return false;
+      }
+      std::string element;
+      if (!validate(data + offset, size, element)) {
+        return false;
+      }
+      if (first) {
+        address = element;
+        first = false;
+      }
+      offset += size;
+    }
+    return !first;
+  }
+
+  // address pattern
+  if (data[0] != '/') {
+    return false;
+  }
+  size_t offset = osc_string_length(data, length);
+  if (offset == 0) {
+    return false;
+  }
+  address = (const char *)data;
+
+  // type tags (optional in OSC 1.0, but always sent by the sketch)
+  if (offset == length) {
+    return true;
+  }
+  if (data[offset] != ',') {
+    return false;
+  }
+  const char *types = (const char *)data + offset + 1;
+  size_t types_length = osc_string_length(data + offset, length - offset);
+  if (types_length == 0) {
+    return false;
+  }
+  offset += types_length;
+
+  // arguments
+  for (; *types; types++) {
+    switch (*types) {
+      case 'i':
+      case 'f':
+        offset += 4;
+        break;
+      case 'h':
+      case 't':
+      case 'd':
+        offset += 8;
+        break;
+      case 's': {
+        size_t size = offset < length ? osc_string_length(data + offset, length - offset) : 0;
+        if (size == 0) {
+          return false;
+        }
+        offset += size;
+        break;
+      }
+      case 'b': {
+        if (offset + 4 > length) {
+          return false;
+        }
+        offset += 4 + ((osc_int(data + offset) + 3) / 4) * 4;
+        break;
+      }
+      case 'T':
+      case 'F':
+      case 'N':
+      case 'I':
+        break;
+      default:
+        return false;
+    }
+    if (offset > length) {
+      return false;
+    }
+  }
+
+  return offset == length;
+}
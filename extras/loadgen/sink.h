@@ -0,0 +1,63 @@
+#ifndef _Sink_H
+#define _Sink_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a packet as received by the sink
+struct SinkPacket {
+  unsigned long time_us;
+  std::string address;
+  bool valid;
+  uint64_t timetag;  // 0 unless it was a bundle
+};
+
+// a TCP connection to the sink, and the SLIP frame it is part way through
+struct SinkConnection {
+  int fd;
+  std::vector<unsigned char> frame;
+  bool escaped;
+};
+
+// OSCSink - a local UDP server (or TCP server taking SLIP framed OSC 1.1) that
+// receives, validates and timestamps every packet sent to it
+class OSCSink {
+  private:
+    int _fd;
+    bool _tcp;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<bool> _drop;
+    std::atomic<unsigned long> _accepted;
+    std::mutex _lock;
+    std::vector<SinkPacket> _packets;
+
+    void run();
+    void run_tcp();
+    void receive(const unsigned char *data, size_t length);
+    bool read(SinkConnection &connection);
+
+  public:
+    OSCSink();
+    ~OSCSink();
+
+    bool begin(unsigned short port, bool tcp = false);
+    void stop();
+
+    // closes every open TCP connection, as a restarting server would
+    void disconnect();
+    unsigned long accepted();
+
+    // copy of everything received so far
+    std::vector<SinkPacket> packets();
+    size_t count();
+
+    // validates an OSC 1.0 message (or bundle of messages), returning the
+    // (first) address pattern in address
+    static bool validate(const unsigned char *data, size_t length, std::string &address);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "sntp.h"
+
+// the reference clock starts at 2026-01-01 00:00:00 (NTP era 0)
+#define REFERENCE_BASE 3976214400ULL
+#define PACKET_SIZE 48
+
+static void put_timestamp(unsigned char *data, uint64_t value) {
+  for (int i = 7; i >= 0; i--) {
+    data[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+SNTPServer::SNTPServer() : _fd(-1), _running(false), _requests(0), _offset_ms(0), _drift_ppm(0) {
+}
+
+SNTPServer::~SNTPServer() {
+  stop();
+}
+
+bool SNTPServer::begin(unsigned short port, double offset_ms, double drift_ppm) {
+  _offset_ms = offset_ms;
+  _drift_ppm = drift_ppm;
+
+  _fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_fd < 0) {
+    return false;
+  }
+
+  // wake up periodically so stop() is noticed
+  timeval timeout = { 0, 100000 };
+  setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(_fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+
+  _running = true;
+  _thread = std::thread(&SNTPServer::run, this);
+  return true;
+}
+
+void SNTPServer::stop() {
+  if (_running) {
+    _running = false;
+    _thread.join();
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+uint64_t SNTPServer::reference(unsigned long us) const {
+  long double seconds = us * 1e-6L * (1.0L + _drift_ppm * 1e-6L) + _offset_ms / 1000.0L;
+  return (REFERENCE_BASE << 32) + (uint64_t)(seconds * 4294967296.0L);
+}
+
+unsigned long SNTPServer::requests() const {
+  return _requests;
+}
+
+void SNTPServer::run() {
+  unsigned char request[PACKET_SIZE];
+
+  while (_running) {
+    sockaddr_in from = {};
+    socklen_t from_length = sizeof(from);
+    ssize_t length = recvfrom(_fd, request, sizeof(request), 0, (sockaddr *)&from, &from_length);
+    uint64_t receive = reference(micros());
+    if (length != PACKET_SIZE || (request[0] & 0x07) != 3) {
+      continue;
+    }
+
+    unsigned char reply[PACKET_SIZE] = {};
+    reply[0] = 0x24;  // LI 0, version 4, mode 4 (server)
+    reply[1] = 1;     // stratum 1
+    reply[2] = request[2];
+    reply[3] = (unsigned char)-20;
+    memcpy(reply + 12, "LOAD", 4);
+    put_timestamp(reply + 16, receive);
+    memcpy(reply + 24, request + 40, 8);
+    put_timestamp(reply + 32, receive);
+    put_timestamp(reply + 40, reference(micros()));
+    sendto(_fd, reply, sizeof(reply), 0, (sockaddr *)&from, from_length);
+    _requests++;
+  }
+}
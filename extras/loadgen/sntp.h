@@ -0,0 +1,35 @@
+#ifndef _SNTP_H
+#define _SNTP_H
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+
+// SNTPServer - a local SNTP stand-in whose reference clock runs from the
+// host clock with a fixed offset and a rate error, so the sketch's clock has
+// something to discipline itself against
+class SNTPServer {
+  private:
+    int _fd;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<unsigned long> _requests;
+    double _offset_ms;
+    double _drift_ppm;
+
+    void run();
+
+  public:
+    SNTPServer();
+    ~SNTPServer();
+
+    bool begin(unsigned short port, double offset_ms, double drift_ppm);
+    void stop();
+
+    // the reference time (NTP format) at the given micros()
+    uint64_t reference(unsigned long us) const;
+
+    unsigned long requests() const;
+};
+
+#endif
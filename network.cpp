@@ -3,11 +3,10 @@
 
 // convert an IP address into a list of ints for the Ethernet library
 IPAddress *ip_str_to_address(const char* ip_str) {
-  // create space for the IP array
   if (!ip_str) {
     return NULL;
   } else {
-    int *ip = (int*)malloc(4 * sizeof(int));
+    int ip[4];
     sscanf(ip_str, "%d.%d.%d.%d", &ip[0], &ip[1], &ip[2], &ip[3]);
     return new IPAddress(ip[0], ip[1], ip[2], ip[3]);
   }